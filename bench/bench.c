@@ -0,0 +1,442 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "../arg.h"
+#include "../slstatus.h"
+#include "../source.h"
+#include "../uring.h"
+#include "../util.h"
+
+struct bench {
+	const char *name;
+	const char *(*func)(const char *);
+	const char *args;
+};
+
+/* what the components expect from slstatus.c and config.h */
+__thread char buf[1024];
+const unsigned int interval = 1000;
+const unsigned int run_timeout = 5000;
+const unsigned int run_period = 1000;
+const unsigned int freq_sample = 64;
+
+/*
+ * components which show the change between two reads are left out, the
+ * fixtures do not change and the links are the live ones
+ */
+static const struct bench benches[] = {
+	{ "battery_perc",       battery_perc,       "BAT0" },
+	{ "battery_remaining",  battery_remaining,  "BAT0" },
+	{ "battery_state",      battery_state,      "BAT0" },
+	{ "cat",                cat,                "/run/message" },
+	{ "cpu_freq",           cpu_freq,           NULL },
+	{ "cpu_freq_all",       cpu_freq_all,       "max" },
+	{ "cpu_freq_clusters",  cpu_freq_clusters,  "avg" },
+	{ "cpu_perc_cores_bar", cpu_perc_cores_bar, NULL },
+	{ "cpu_perc_cores_max", cpu_perc_cores_max, NULL },
+	{ "cpu_perc_cores_top", cpu_perc_cores_top, "3" },
+	{ "datetime",           datetime,           "%F %T" },
+	{ "disk_free",          disk_free,          "/" },
+	{ "disk_perc",          disk_perc,          "/" },
+	{ "entropy",            entropy,            NULL },
+	{ "file_message",       file_message,       "/run/message" },
+	{ "hostname",           hostname,           NULL },
+	{ "ipv4",               ipv4,               "lo" },
+	{ "ipv6",               ipv6,               "lo" },
+	{ "kernel_release",     kernel_release,     NULL },
+	{ "load_avg",           load_avg,           NULL },
+	{ "lm_sensors",         lm_sensors,         "" },
+	{ "net_drops",          net_drops,          "lo" },
+	{ "net_errors",         net_errors,         "lo" },
+	{ "num_files",          num_files,          "/maildir/cur" },
+	{ "ram_free",           ram_free,           NULL },
+	{ "ram_perc",           ram_perc,           NULL },
+	{ "ram_total",          ram_total,          NULL },
+	{ "ram_used",           ram_used,           NULL },
+	{ "swap_free",          swap_free,          NULL },
+	{ "swap_perc",          swap_perc,          NULL },
+	{ "swap_total",         swap_total,         NULL },
+	{ "swap_used",          swap_used,          NULL },
+	{ "temp",               temp,
+	  "/sys/class/thermal/thermal_zone0/temp" },
+	{ "tmp_perc_gt",        tmp_perc_gt,        "0" },
+	{ "up",                 up,                 "lo" },
+	{ "uptime",             uptime,             NULL },
+	{ "username",           username,           NULL },
+	{ "vpn_state",          vpn_state,          "vpn0" },
+};
+
+/* the components of an update which read files, for the syscalls per tick */
+static const struct bench update[] = {
+	{ "battery_perc",       battery_perc,       "BAT0" },
+	{ "battery_state",      battery_state,      "BAT0" },
+	{ "cpu_freq",           cpu_freq,           NULL },
+	{ "cpu_freq_all",       cpu_freq_all,       "max" },
+	{ "cpu_freq_clusters",  cpu_freq_clusters,  "avg" },
+	{ "cpu_perc",           cpu_perc,           NULL },
+	{ "entropy",            entropy,            NULL },
+	{ "netspeed_rx",        netspeed_rx,        "lo" },
+	{ "netspeed_tx",        netspeed_tx,        "lo" },
+	{ "ram_perc",           ram_perc,           NULL },
+	{ "temp",               temp,
+	  "/sys/class/thermal/thermal_zone0/temp" },
+};
+
+/* large procfs files for the scanner throughput */
+static const char *scanfiles[] = {
+	"/proc/stat", "/proc/interrupts", "/proc/net/dev",
+};
+
+static unsigned long allocs;
+static int errfd = -1, nullfd = -1; /* stderr and /dev/null */
+
+/* the main loop is not running, components fall back to polling */
+int
+watch(int fd, int (*cb)(int fd, void *data), void *data)
+{
+	return -1;
+}
+
+void
+unwatch(int fd)
+{
+}
+
+#if defined(__GLIBC__)
+/* count allocations, including those made inside libc */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *
+malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *p, size_t size)
+{
+	allocs++;
+	return __libc_realloc(p, size);
+}
+#endif
+
+/*
+ * components warn about what the fixtures lack, silence them while they
+ * run to keep the table, but not our own errors
+ */
+static void
+quiet(int on)
+{
+	fflush(stderr);
+	if (dup2(on ? nullfd : errfd, 2) < 0)
+		die("dup2:");
+}
+
+/* like pscanf, but always on the live system */
+static int
+lscan(const char *path, const char *fmt, void *a, void *b)
+{
+	FILE *fp;
+	int n;
+
+	if (!(fp = fopen(path, "r")))
+		return -1;
+	n = fscanf(fp, fmt, a, b);
+	fclose(fp);
+
+	return n;
+}
+
+/*
+ * count our syscalls with the raw_syscalls:sys_enter tracepoint, or fall
+ * back to the read and write syscalls accounted in /proc/self/io
+ */
+static int
+syscounter(void)
+{
+	struct perf_event_attr attr;
+	uintmax_t id;
+	int fd;
+
+	if (lscan("/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+	          "%ju", &id, NULL) != 1 &&
+	    lscan("/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+	          "%ju", &id, NULL) != 1)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = id;
+	attr.disabled = 1;
+	if ((fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) < 0)
+		return -1;
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+	return fd;
+}
+
+static uint64_t
+syscalls(int fd)
+{
+	uint64_t n;
+	uintmax_t r, w;
+
+	if (fd >= 0)
+		return read(fd, &n, sizeof(n)) == sizeof(n) ? n : 0;
+
+	if (lscan("/proc/self/io", "%*s %*u %*s %*u %*s %ju %*s %ju",
+	          &r, &w) != 2)
+		return 0;
+
+	return r + w;
+}
+
+static uint64_t
+nanotime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the sum of all numbers in the file, as the scanf(3) family sees it */
+static uintmax_t
+stdiosum(FILE *fp)
+{
+	uintmax_t v, sum;
+	int n;
+
+	rewind(fp);
+	for (sum = 0; (n = fscanf(fp, "%ju", &v)) != EOF;)
+		if (n == 1)
+			sum += v;
+		else if (fscanf(fp, "%*s") == EOF)
+			break;
+
+	return sum;
+}
+
+static uintmax_t
+scansum(const char *s, const char *end)
+{
+	uintmax_t v, sum;
+	const char *eol, *p, *q;
+
+	for (sum = 0; s < end; s = eol + 1) {
+		eol = scanline(s, end);
+		for (p = skipblank(s); p < eol; p = skipblank(p)) {
+			if ((q = scannum(p, &v))) {
+				sum += v;
+				p = q;
+				continue;
+			}
+			while (p < eol && *p != ' ' && *p != '\t')
+				p++;
+		}
+	}
+
+	return sum;
+}
+
+/* throughput of the scanners against vfscanf on the same bytes */
+static void
+scanbench(const char *root, unsigned long iters)
+{
+	FILE *fp;
+	uint64_t start, ns[2];
+	uintmax_t sum[2];
+	unsigned long n;
+	size_t i, len;
+	char path[PATH_MAX], *b;
+
+	printf("\n%-18s %12s %12s %12s\n", "file", "bytes", "vfscanf GB/s",
+	       "scan GB/s");
+
+	for (i = 0; i < LEN(scanfiles); i++) {
+		if (esnprintf(path, sizeof(path), "%s%s", root,
+		              scanfiles[i]) < 0 || !(fp = fopen(path, "r")))
+			continue;
+		if (!(b = calloc(1, 1 << 20 | SCANPAD)) ||
+		    !(len = fread(b, 1, 1 << 20, fp))) {
+			fclose(fp);
+			free(b);
+			continue;
+		}
+		fclose(fp);
+		if (!(fp = fmemopen(b, len, "r")))
+			die("fmemopen:");
+
+		sum[0] = sum[1] = 0;
+		start = nanotime();
+		for (n = 0; n < iters / 10 + 1; n++)
+			sum[0] = stdiosum(fp);
+		ns[0] = (nanotime() - start) / n;
+
+		start = nanotime();
+		for (n = 0; n < iters; n++)
+			sum[1] = scansum(b, b + len);
+		ns[1] = (nanotime() - start) / n;
+
+		printf("%-18s %12zu %12.2f %12.2f%s\n", scanfiles[i], len,
+		       (double)len / ns[0], (double)len / ns[1],
+		       sum[0] == sum[1] ? "" : " (mismatch)");
+		fclose(fp);
+		free(b);
+	}
+}
+
+static void
+runupdate(void)
+{
+	size_t i;
+
+	nexttick();
+	prefetch(UINT64_MAX);
+	for (i = 0; i < LEN(update); i++) {
+		reader = i + 1;
+		update[i].func(update[i].args);
+	}
+	reader = 0;
+}
+
+/* all of update[] as one tick, reading file by file and batched */
+static void
+tickbench(int fd, uint64_t self, unsigned long iters)
+{
+	uint64_t start, ns, sys;
+	unsigned long n, enters;
+	int mode;
+
+	/* /proc/self/io does not see io_uring_enter, it is counted apart */
+	printf("\n%-18s %12s %12s %12s\n", "update", "ns/tick",
+	       fd >= 0 ? "syscalls" : "rd+wr calls", "uring enters");
+
+	for (mode = 0; mode < 2; mode++) {
+		if (mode && prefetchinit() < 0) {
+			printf("%-18s %12s %12s %12s\n", "io_uring", "n/a", "n/a",
+			       "n/a");
+			break;
+		}
+
+		/* register the files with the readers */
+		quiet(1);
+		runupdate();
+
+		sys = syscalls(fd);
+		enters = uringenters;
+		start = nanotime();
+		for (n = 0; n < iters; n++)
+			runupdate();
+		ns = nanotime() - start;
+		enters = uringenters - enters;
+		sys = syscalls(fd) - sys;
+		quiet(0);
+
+		sys = sys > self ? sys - self : 0;
+		printf("%-18s %12.0f %12.2f %12.2f\n", mode ? "io_uring" : "pread",
+		       (double)ns / iters, (double)sys / iters,
+		       (double)enters / iters);
+	}
+}
+
+static void
+usage(void)
+{
+	die("usage: %s [-n iterations] fixtures", argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const struct bench *b;
+	uint64_t start, ns, sys, self;
+	unsigned long n, iters, nulls, a;
+	size_t i;
+	int fd;
+
+	iters = 1000;
+	ARGBEGIN {
+	case 'n':
+		iters = strtoul(EARGF(usage()), NULL, 0);
+		break;
+	default:
+		usage();
+	} ARGEND
+
+	if (argc != 1 || !iters)
+		usage();
+
+	/* absolute paths of the components are read from the fixtures */
+	if (setenv("SLSTATUS_SYSROOT", argv[0], 1) < 0)
+		die("setenv:");
+
+	if ((nullfd = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0)
+		die("open '/dev/null':");
+	if ((errfd = fcntl(2, F_DUPFD_CLOEXEC, 3)) < 0)
+		die("fcntl:");
+
+	/* the syscalls of reading the counter itself */
+	fd = syscounter();
+	self = syscalls(fd);
+	self = syscalls(fd) - self;
+
+	printf("%-18s %12s %12s %12s %8s\n", "component", "ns/call",
+	       fd >= 0 ? "syscalls" : "rd+wr calls", "allocs/call", "nulls");
+
+	for (i = 0; i < LEN(benches); i++) {
+		b = &benches[i];
+
+		/* warm up caches and the state of delta components */
+		quiet(1);
+		nexttick();
+		b->func(b->args);
+
+		nulls = 0;
+		sys = syscalls(fd);
+		a = allocs;
+		start = nanotime();
+		for (n = 0; n < iters; n++) {
+			/* every call is a tick of its own, sources are reread */
+			nexttick();
+			nulls += !b->func(b->args);
+		}
+		ns = nanotime() - start;
+		a = allocs - a;
+		sys = syscalls(fd) - sys;
+		quiet(0);
+
+		sys = sys > self ? sys - self : 0;
+		printf("%-18s %12.0f %12.2f %12.2f %8lu\n", b->name,
+		       (double)ns / iters, (double)sys / iters,
+		       (double)a / iters, nulls);
+	}
+
+	tickbench(fd, self, iters);
+	scanbench(argv[0], iters);
+
+	return 0;
+}
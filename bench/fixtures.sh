@@ -0,0 +1,179 @@
+#!/bin/sh
+# See LICENSE file for copyright and license details.
+# create the fixture tree for the benchmarks in $1:
+# a 256-core /proc/stat, /proc/interrupts and cpufreq, a /proc/net/dev with 64
+# interfaces, a /proc/meminfo with hugepages, sysfs attributes
+# for a battery, a network interface, a thermal zone and hwmon, and a maildir
+# holding 100000 messages
+set -e
+
+root=${1:?usage: fixtures.sh dir}
+ncpu=256
+nmail=100000
+
+mkdir -p "$root/proc/sys/kernel/random" "$root/proc/net" \
+         "$root/sys/class/power_supply/BAT0" \
+         "$root/sys/class/net/vpn0" \
+         "$root/sys/class/thermal/thermal_zone0" \
+         "$root/sys/devices/system/cpu/cpu0/cpufreq" \
+         "$root/run" "$root/maildir/cur" "$root/maildir/new" \
+         "$root/maildir/tmp"
+
+awk -v n=$ncpu 'BEGIN {
+	srand(1)
+	printf "cpu  %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f 0 0\n", 2549421 * n, 6131 * n,
+	       692163 * n, 90617244 * n, 61211 * n, 0, 26431 * n, 0
+	for (i = 0; i < n; i++)
+		printf "cpu%d %d %d %d %d %d %d %d %d 0 0\n", i,
+		       2549421 + int(rand() * 1e5), 6131, 692163, 90617244,
+		       61211, 0, 26431 + int(rand() * 1e3), int(rand() * 100)
+	printf "intr 1836742932 9 0 0 0 0 0 0 0 1 0 0 0 0 0 0 0 0"
+	for (i = 0; i < 1024; i++)
+		printf " %d", int(rand() * 1e6)
+	printf "\nctxt 3624361372\nbtime 1700000000\nprocesses 4126473\n"
+	printf "procs_running 3\nprocs_blocked 0\n"
+	printf "softirq 822187353 0 123018281 41624 63466405 1253284 0 "
+	printf "2076104 367081046 18632 263170189\n"
+}' > "$root/proc/stat"
+
+awk -v n=$ncpu 'BEGIN {
+	srand(2)
+	printf "    "
+	for (i = 0; i < n; i++)
+		printf " %10s", "CPU" i
+	printf "\n"
+	for (irq = 0; irq < 160; irq++) {
+		printf "%3d:", irq
+		for (i = 0; i < n; i++)
+			printf " %10d", int(rand() * 1e7)
+		printf "  IR-PCI-MSI %d-edge eth0-TxRx-%d\n", 524288 + irq, irq
+	}
+	printf "LOC:"
+	for (i = 0; i < n; i++)
+		printf " %10d", int(rand() * 1e9)
+	printf "   Local timer interrupts\n"
+}' > "$root/proc/interrupts"
+
+awk 'BEGIN {
+	srand(3)
+	print "Inter-|   Receive                                                |  Transmit"
+	print " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed"
+	for (i = 0; i < 64; i++) {
+		printf "%6s:", "veth" i
+		for (j = 0; j < 16; j++)
+			printf " %.0f", j % 8 < 2 ? int(rand() * 1e12) : int(rand() * 1e3)
+		printf "\n"
+	}
+}' > "$root/proc/net/dev"
+
+cat > "$root/proc/meminfo" <<'MEMINFO'
+MemTotal:       263847532 kB
+MemFree:        198412236 kB
+MemAvailable:   241032480 kB
+Buffers:          512204 kB
+Cached:         39827364 kB
+SwapCached:         1024 kB
+Active:         19532812 kB
+Inactive:       34210764 kB
+Active(anon):   12019544 kB
+Inactive(anon):  1730300 kB
+Active(file):    7513268 kB
+Inactive(file): 32480464 kB
+Unevictable:       18752 kB
+Mlocked:           18752 kB
+SwapTotal:      33554428 kB
+SwapFree:       33019388 kB
+Zswap:                 0 kB
+Zswapped:              0 kB
+Dirty:              1220 kB
+Writeback:             0 kB
+AnonPages:      13403244 kB
+Mapped:          2134812 kB
+Shmem:            347336 kB
+KReclaimable:    2361236 kB
+Slab:            4512844 kB
+SReclaimable:    2361236 kB
+SUnreclaim:      2151608 kB
+KernelStack:       82496 kB
+PageTables:       158252 kB
+SecPageTables:         0 kB
+NFS_Unstable:          0 kB
+Bounce:                0 kB
+WritebackTmp:          0 kB
+CommitLimit:    165478192 kB
+Committed_AS:   41532968 kB
+VmallocTotal:   34359738367 kB
+VmallocUsed:      712340 kB
+VmallocChunk:          0 kB
+Percpu:           901120 kB
+HardwareCorrupted:     0 kB
+AnonHugePages:   6291456 kB
+ShmemHugePages:        0 kB
+ShmemPmdMapped:        0 kB
+FileHugePages:         0 kB
+FilePmdMapped:         0 kB
+CmaTotal:              0 kB
+CmaFree:               0 kB
+Unaccepted:            0 kB
+HugePages_Total:    8192
+HugePages_Free:     6144
+HugePages_Rsvd:      512
+HugePages_Surp:        0
+Hugepagesize:       2048 kB
+Hugetlb:        16777216 kB
+DirectMap4k:     1893220 kB
+DirectMap2M:    95129600 kB
+DirectMap1G:    173015040 kB
+MEMINFO
+
+echo 256 > "$root/proc/sys/kernel/random/entropy_avail"
+
+echo 87 > "$root/sys/class/power_supply/BAT0/capacity"
+echo Discharging > "$root/sys/class/power_supply/BAT0/status"
+echo 48210000 > "$root/sys/class/power_supply/BAT0/energy_now"
+echo 9120000 > "$root/sys/class/power_supply/BAT0/power_now"
+
+echo up > "$root/sys/class/net/vpn0/operstate"
+
+echo 47000 > "$root/sys/class/thermal/thermal_zone0/temp"
+
+# hwmon of a k10temp cpu, a discrete amdgpu and a thinkpad fan
+hwmon="$root/sys/class/hwmon"
+gpu="$root/sys/devices/pci0000:00/0000:03:00.0"
+mkdir -p "$hwmon/hwmon0" "$hwmon/hwmon1" "$hwmon/hwmon2" "$gpu"
+ln -sfn ../../../devices/pci0000:00/0000:03:00.0 "$hwmon/hwmon1/device"
+echo k10temp > "$hwmon/hwmon0/name"
+echo Tctl > "$hwmon/hwmon0/temp1_label"
+echo 61250 > "$hwmon/hwmon0/temp1_input"
+echo Tccd1 > "$hwmon/hwmon0/temp3_label"
+echo 54750 > "$hwmon/hwmon0/temp3_input"
+echo Tccd2 > "$hwmon/hwmon0/temp4_label"
+echo 52000 > "$hwmon/hwmon0/temp4_input"
+echo amdgpu > "$hwmon/hwmon1/name"
+echo edge > "$hwmon/hwmon1/temp1_label"
+echo 48000 > "$hwmon/hwmon1/temp1_input"
+echo junction > "$hwmon/hwmon1/temp2_label"
+echo 53000 > "$hwmon/hwmon1/temp2_input"
+echo 35000000 > "$hwmon/hwmon1/power1_average"
+echo thinkpad > "$hwmon/hwmon2/name"
+echo 3900 > "$hwmon/hwmon2/fan1_input"
+# 64 performance and 192 efficiency cores
+i=0
+while [ $i -lt $ncpu ]; do
+	cpu="$root/sys/devices/system/cpu/cpu$i"
+	mkdir -p "$cpu/cpufreq" "$cpu/topology"
+	echo $((i < 64 ? 0 : 1)) > "$cpu/topology/cluster_id"
+	echo $((i < 64 ? 3187402 + i * 1000 : 2100000 + i * 100)) \
+		> "$cpu/cpufreq/scaling_cur_freq"
+	i=$((i + 1))
+done
+
+echo "42.7" > "$root/run/message"
+
+# maildir names as written by mail delivery agents
+cd "$root/maildir/cur"
+awk -v n=$nmail 'BEGIN {
+	for (i = 0; i < n; i++)
+		printf "17%08d.M%dP%d.bench,S=%d:2,S\n", i, i, 4000 + i % 997,
+		       2048 + i % 8192
+}' | xargs touch
@@ -22,16 +22,23 @@
 	#define POWER_SUPPLY_CURRENT  "/sys/class/power_supply/%s/current_now"
 	#define POWER_SUPPLY_POWER    "/sys/class/power_supply/%s/power_now"
 
+	static int
+	readable(const char *path)
+	{
+		char p[PATH_MAX];
+
+		return (path = rootpath(path, p, sizeof(p))) &&
+		       access(path, R_OK) == 0;
+	}
+
 	static const char *
 	pick(const char *bat, const char *f1, const char *f2, char *path,
 	     size_t length)
 	{
-		if (esnprintf(path, length, f1, bat) > 0 &&
-		    access(path, R_OK) == 0)
+		if (esnprintf(path, length, f1, bat) > 0 && readable(path))
 			return f1;
 
-		if (esnprintf(path, length, f2, bat) > 0 &&
-		    access(path, R_OK) == 0)
+		if (esnprintf(path, length, f2, bat) > 0 && readable(path))
 			return f2;
 
 		return NULL;
@@ -40,15 +47,15 @@
 	const char *
 	battery_perc(const char *bat)
 	{
-		int cap_perc;
+		uintmax_t cap_perc;
 		char path[PATH_MAX];
 
 		if (esnprintf(path, sizeof(path), POWER_SUPPLY_CAPACITY, bat) < 0)
 			return NULL;
-		if (pscanf(path, "%d", &cap_perc) != 1)
+		if (pnum(path, &cap_perc) < 0)
 			return NULL;
 
-		return bprintf("%d", cap_perc);
+		return bprintf("%ju", cap_perc);
 	}
 
 	const char *
@@ -92,13 +99,13 @@
 
 		if (!pick(bat, POWER_SUPPLY_CHARGE, POWER_SUPPLY_ENERGY, path,
 		          sizeof(path)) ||
-		    pscanf(path, "%ju", &charge_now) < 0)
+		    pnum(path, &charge_now) < 0)
 			return NULL;
 
 		if (!strcmp(state, "Discharging")) {
 			if (!pick(bat, POWER_SUPPLY_CURRENT, POWER_SUPPLY_POWER, path,
 			          sizeof(path)) ||
-			    pscanf(path, "%ju", &current_now) < 0)
+			    pnum(path, &current_now) < 0)
 				return NULL;
 
 			if (current_now == 0)
@@ -3,30 +3,16 @@
 #include <string.h>
 
 #include "../slstatus.h"
+#include "../source.h"
 #include "../util.h"
 
 const char *
 cat(const char *path)
 {
-        char *f;
-        FILE *fp;
-
-        if (!(fp = fopen(path, "r"))) {
-                warn("fopen '%s':", path);
+        if (watchline(path, buf, sizeof(buf)) < 0) {
+                warn("open '%s':", path);
                 return NULL;
         }
 
-        f = fgets(buf, sizeof(buf) - 1, fp);
-        if (fclose(fp) < 0) {
-                warn("fclose '%s':", path);
-                return NULL;
-        }
-        if (!f)
-                return NULL;
-
-        if ((f = strrchr(buf, '\n')))
-                f[0] = '\0';
-
         return buf[0] ? buf : NULL;
 }
-
@@ -0,0 +1,127 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../slstatus.h"
+#include "../util.h"
+
+/* delay before restarting an exited command (in ms) */
+#define BACKOFF_MIN 1000
+#define BACKOFF_MAX 60000
+
+struct coproc {
+	const char *cmd;
+	pid_t pid;
+	int fd;
+	uintmax_t started, restart; /* in ms */
+	unsigned int backoff;       /* in ms */
+	size_t len;
+	char partial[1024];
+	char line[1024];
+};
+
+static void
+stop(struct coproc *c)
+{
+	uintmax_t now;
+
+	unwatch(c->fd);
+	close(c->fd);
+	c->fd = -1;
+
+	/* a command which ran for a while restarts quickly again */
+	now = monotonic();
+	if (now - c->started >= BACKOFF_MAX)
+		c->backoff = BACKOFF_MIN;
+	c->restart = now + c->backoff;
+	c->backoff = MIN(c->backoff * 2, BACKOFF_MAX);
+}
+
+static int
+readco(int fd, void *data)
+{
+	struct coproc *c = data;
+	ssize_t r;
+	char *nl;
+	int changed;
+
+	changed = 0;
+	for (;;) {
+		if ((r = read(c->fd, c->partial + c->len,
+		              sizeof(c->partial) - 1 - c->len)) <= 0)
+			break;
+		c->len += r;
+		c->partial[c->len] = '\0';
+
+		/* keep the last complete line, overlong lines are cut */
+		while ((nl = strchr(c->partial, '\n')) ||
+		       c->len == sizeof(c->partial) - 1) {
+			if (nl)
+				*nl = '\0';
+			memcpy(c->line, c->partial, sizeof(c->line));
+			changed = 1;
+
+			if (!nl) {
+				c->len = 0;
+				break;
+			}
+			c->len -= nl + 1 - c->partial;
+			memmove(c->partial, nl + 1, c->len + 1);
+		}
+	}
+	if (r == 0)
+		stop(c);
+
+	return changed;
+}
+
+/*
+ * start cmd once and show the last line it wrote to stdout. when it exits
+ * it is started again, with a backoff doubling up to BACKOFF_MAX.
+ */
+const char *
+coprocess(const char *cmd)
+{
+	static struct coproc cps[8];
+	struct coproc *c;
+	size_t i;
+
+	for (i = 0; i < LEN(cps) && cps[i].cmd && strcmp(cps[i].cmd, cmd);
+	     i++)
+		;
+	if (i == LEN(cps)) {
+		warn("coprocess: Too many commands");
+		return NULL;
+	}
+	c = &cps[i];
+	if (!c->cmd) {
+		c->cmd = cmd;
+		c->pid = c->fd = -1;
+		c->backoff = BACKOFF_MIN;
+	}
+
+	/* without a watch, poll for new lines */
+	if (c->fd >= 0)
+		readco(c->fd, c);
+	if (c->pid > 0 && waitpid(c->pid, NULL, WNOHANG) != 0)
+		c->pid = -1;
+
+	if (c->pid < 0 && c->fd < 0 && monotonic() >= c->restart) {
+		c->started = monotonic();
+		if ((c->pid = spawn(cmd, &c->fd)) < 0) {
+			c->fd = -1;
+			c->restart = c->started + c->backoff;
+			c->backoff = MIN(c->backoff * 2, BACKOFF_MAX);
+		} else {
+			c->len = 0;
+			fcntl(c->fd, F_SETFL, O_NONBLOCK);
+			watch(c->fd, readco, c);
+		}
+	}
+
+	return c->line[0] ? c->line : NULL;
+}
@@ -1,12 +1,16 @@
 /* See LICENSE file for copyright and license details. */
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../slstatus.h"
 #include "../util.h"
 
 #if defined(__linux__)
+	#include "../source.h"
+
 	#define CPU_FREQ "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
 
 	const char *
@@ -15,37 +19,209 @@
 		uintmax_t freq;
 
 		/* in kHz */
-		if (pscanf(CPU_FREQ, "%ju", &freq) != 1)
+		if (pnum(CPU_FREQ, &freq) < 0)
 			return NULL;
 
 		return fmt_human(freq * 1000, 1000);
 	}
 
+	/* min, max or avg (the default) of the known frequencies of a cluster */
+	static uintmax_t
+	freqstat(const struct cpufreqs *f, int cluster, int all,
+	         const char *stat)
+	{
+		uintmax_t min, max, sum;
+		size_t i, n;
+
+		min = UINTMAX_MAX;
+		for (i = n = max = sum = 0; i < f->n; i++) {
+			if (!f->khz[i] || (!all && f->cluster[i] != cluster))
+				continue;
+			min = MIN(min, f->khz[i]);
+			max = f->khz[i] > max ? f->khz[i] : max;
+			sum += f->khz[i];
+			n++;
+		}
+		if (!n)
+			return 0;
+
+		if (stat && !strcmp(stat, "min"))
+			return min;
+		else if (stat && !strcmp(stat, "max"))
+			return max;
+		return sum / n;
+	}
+
+	const char *
+	cpu_freq_all(const char *stat)
+	{
+		const struct cpufreqs *f;
+		uintmax_t khz;
+
+		if (!(f = getfreqs())) {
+			putfreqs();
+			return NULL;
+		}
+		khz = freqstat(f, 0, 1, stat);
+		putfreqs();
+
+		return khz ? fmt_human(khz * 1000, 1000) : NULL;
+	}
+
+	const char *
+	cpu_freq_clusters(const char *stat)
+	{
+		const struct cpufreqs *f;
+		size_t i, len;
+		int c, next, ret;
+		char out[sizeof(buf)];
+
+		if (!(f = getfreqs())) {
+			putfreqs();
+			return NULL;
+		}
+
+		/* the clusters in ascending order as cluster:frequency */
+		out[0] = '\0';
+		for (c = INT_MIN, len = 0;; c = next) {
+			for (i = 0, next = INT_MAX; i < f->n; i++)
+				if (f->cluster[i] > c && f->cluster[i] < next)
+					next = f->cluster[i];
+			if (next == INT_MAX)
+				break;
+			if ((ret = esnprintf(out + len, sizeof(out) - len,
+			                     "%s%d:%s", len ? " " : "", next,
+			                     fmt_human(freqstat(f, next, 0, stat) *
+			                               1000, 1000))) < 0)
+				break;
+			len += ret;
+		}
+		putfreqs();
+
+		return bprintf("%s", out);
+	}
+
 	const char *
 	cpu_perc(const char *unused)
 	{
-		static long double a[7];
-		long double b[7], sum;
+		static struct cpustat a;
+		struct cpustat b;
+		uintmax_t sum, busy;
 
-		memcpy(b, a, sizeof(b));
-		/* cpu user nice system idle iowait irq softirq */
-		if (pscanf("/proc/stat", "%*s %Lf %Lf %Lf %Lf %Lf %Lf %Lf",
-		           &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &a[6])
-		    != 7)
+		memcpy(&b, &a, sizeof(b));
+		if (cpustat(&a) < 0)
 			return NULL;
 
-		if (b[0] == 0)
+		if (b.user == 0)
 			return NULL;
 
-		sum = (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6]) -
-		      (a[0] + a[1] + a[2] + a[3] + a[4] + a[5] + a[6]);
+		/* user nice system idle iowait irq softirq steal */
+		sum = (a.user + a.nice + a.system + a.idle + a.iowait + a.irq +
+		       a.softirq + a.steal) -
+		      (b.user + b.nice + b.system + b.idle + b.iowait + b.irq +
+		       b.softirq + b.steal);
 
 		if (sum == 0)
 			return NULL;
 
-		return bprintf("%d", (int)(100 *
-		               ((b[0] + b[1] + b[2] + b[5] + b[6]) -
-		                (a[0] + a[1] + a[2] + a[5] + a[6])) / sum));
+		/* time stolen by the hypervisor counts as busy */
+		busy = (a.user + a.nice + a.system + a.irq + a.softirq +
+		        a.steal) -
+		       (b.user + b.nice + b.system + b.irq + b.softirq + b.steal);
+
+		return bprintf("%d", (int)(100 * busy / sum));
+	}
+
+	const char *
+	cpu_perc_cores_max(const char *unused)
+	{
+		const struct cpucores *cc;
+		size_t i;
+		int max;
+
+		if (!(cc = getcores())) {
+			putcores();
+			return NULL;
+		}
+		for (i = max = 0; i < cc->n; i++)
+			if (cc->perc[i] > max)
+				max = cc->perc[i];
+		putcores();
+
+		return bprintf("%d", max);
+	}
+
+	const char *
+	cpu_perc_cores_top(const char *num)
+	{
+		const struct cpucores *cc;
+		size_t i, j, k, n, len, top[16];
+		int ret;
+
+		/* the busiest cores as cpu:percent, 3 by default */
+		n = num ? strtoul(num, NULL, 10) : 3;
+		n = n ? MIN(n, LEN(top)) : 1;
+
+		if (!(cc = getcores())) {
+			putcores();
+			return NULL;
+		}
+
+		/* insert every core into the sorted list of the top n */
+		for (i = k = 0; i < cc->n; i++) {
+			if (k == n && cc->perc[i] <= cc->perc[top[n - 1]])
+				continue;
+			for (j = (k < n) ? k++ : n - 1;
+			     j > 0 && cc->perc[top[j - 1]] < cc->perc[i]; j--)
+				top[j] = top[j - 1];
+			top[j] = i;
+		}
+
+		buf[0] = '\0';
+		for (j = len = 0; j < k; j++) {
+			if ((ret = esnprintf(buf + len, sizeof(buf) - len,
+			                     "%s%u:%d", j ? " " : "",
+			                     cc->id[top[j]],
+			                     cc->perc[top[j]])) < 0)
+				break;
+			len += ret;
+		}
+		putcores();
+
+		return buf;
+	}
+
+	const char *
+	cpu_perc_cores_bar(const char *unused)
+	{
+		static const char *bars[] = {
+			"\u2581", "\u2582", "\u2583", "\u2584",
+			"\u2585", "\u2586", "\u2587", "\u2588",
+		};
+		const struct cpucores *cc;
+		size_t i, j, g, len, w;
+		int max;
+
+		if (!(cc = getcores())) {
+			putcores();
+			return NULL;
+		}
+
+		/* neighbours share a bar showing their maximum if need be */
+		w = (sizeof(buf) - 1) / strlen(bars[0]);
+		g = (cc->n + w - 1) / w;
+		for (i = len = 0; i < cc->n; i += g) {
+			for (j = i, max = 0; j < i + g && j < cc->n; j++)
+				if (cc->perc[j] > max)
+					max = cc->perc[j];
+			memcpy(buf + len, bars[max * LEN(bars) / 101],
+			       strlen(bars[0]));
+			len += strlen(bars[0]);
+		}
+		buf[len] = '\0';
+		putcores();
+
+		return buf;
 	}
 #elif defined(__OpenBSD__)
 	#include <sys/param.h>
@@ -13,7 +13,7 @@
 	{
 		uintmax_t num;
 
-		if (pscanf(ENTROPY_AVAIL, "%ju", &num) != 1)
+		if (pnum(ENTROPY_AVAIL, &num) < 0)
 			return NULL;
 
 		return bprintf("%ju", num);
@@ -13,41 +13,48 @@
 #endif
 
 #include "../slstatus.h"
+#include "../source.h"
 #include "../util.h"
 
-static const char *
-ip(const char *interface, unsigned short sa_family)
-{
-	struct ifaddrs *ifaddr, *ifa;
-	int s;
-	char host[NI_MAXHOST];
+#if defined(__linux__)
+	static const char *
+	ip(const char *interface, unsigned short sa_family)
+	{
+		char host[NI_MAXHOST];
 
-	if (getifaddrs(&ifaddr) < 0) {
-		warn("getifaddrs:");
-		return NULL;
+		if (linkaddr(interface, sa_family, host, sizeof(host)) < 0)
+			return NULL;
+
+		return bprintf("%s", host);
 	}
+#else
+	static const char *
+	ip(const char *interface, unsigned short sa_family)
+	{
+		struct ifaddrs *ifa;
+		int s;
+		char host[NI_MAXHOST];
 
-	for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-		if (!ifa->ifa_addr)
-			continue;
+		for (ifa = getifs(); ifa != NULL; ifa = ifa->ifa_next) {
+			if (!ifa->ifa_addr || strcmp(ifa->ifa_name, interface) ||
+			    ifa->ifa_addr->sa_family != sa_family)
+				continue;
 
-		s = getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in6),
-		                host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
-		if (!strcmp(ifa->ifa_name, interface) &&
-		    (ifa->ifa_addr->sa_family == sa_family)) {
-			freeifaddrs(ifaddr);
+			s = getnameinfo(ifa->ifa_addr,
+			                sizeof(struct sockaddr_in6), host,
+			                NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+			putifs();
 			if (s != 0) {
 				warn("getnameinfo: %s", gai_strerror(s));
 				return NULL;
 			}
 			return bprintf("%s", host);
 		}
-	}
-
-	freeifaddrs(ifaddr);
+		putifs();
 
-	return NULL;
-}
+		return NULL;
+	}
+#endif
 
 const char *
 ipv4(const char *interface)
@@ -61,27 +68,35 @@ ipv6(const char *interface)
 	return ip(interface, AF_INET6);
 }
 
-const char *
-up(const char *interface)
-{
-	struct ifaddrs *ifaddr, *ifa;
+#if defined(__linux__)
+	const char *
+	up(const char *interface)
+	{
+		unsigned int flags;
+		unsigned char oper;
 
-	if (getifaddrs(&ifaddr) < 0) {
-		warn("getifaddrs:");
-		return NULL;
+		if (linkstate(interface, &flags, &oper) < 0)
+			return NULL;
+
+		return flags & IFF_UP ? "up" : "down";
 	}
+#else
+	const char *
+	up(const char *interface)
+	{
+		struct ifaddrs *ifa;
+		const char *state;
 
-	for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-		if (!ifa->ifa_addr)
-			continue;
+		for (ifa = getifs(); ifa != NULL; ifa = ifa->ifa_next) {
+			if (!ifa->ifa_addr || strcmp(ifa->ifa_name, interface))
+				continue;
 
-		if (!strcmp(ifa->ifa_name, interface)) {
-			freeifaddrs(ifaddr);
-			return ifa->ifa_flags & IFF_UP ? "up" : "down";
+			state = ifa->ifa_flags & IFF_UP ? "up" : "down";
+			putifs();
+			return state;
 		}
-	}
-
-	freeifaddrs(ifaddr);
+		putifs();
 
-	return NULL;
-}
+		return NULL;
+	}
+#endif
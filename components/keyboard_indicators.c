@@ -2,9 +2,9 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
-#include <X11/Xlib.h>
 
 #include "../slstatus.h"
+#include "../source.h"
 #include "../util.h"
 
 /*
@@ -17,18 +17,18 @@
 const char *
 keyboard_indicators(const char *fmt)
 {
-	Display *dpy;
-	XKeyboardState state;
+	const struct xkbstate *xkb;
+	unsigned int leds;
 	size_t fmtlen, i, n;
 	int togglecase, isset;
 	char key;
 
-	if (!(dpy = XOpenDisplay(NULL))) {
-		warn("XOpenDisplay: Failed to open display");
+	if (!(xkb = getxkb())) {
+		putxkb();
 		return NULL;
 	}
-	XGetKeyboardControl(dpy, &state);
-	XCloseDisplay(dpy);
+	leds = xkb->leds;
+	putxkb();
 
 	fmtlen = strnlen(fmt, 4);
 	for (i = n = 0; i < fmtlen; i++) {
@@ -37,7 +37,7 @@ keyboard_indicators(const char *fmt)
 			continue;
 
 		togglecase = (i + 1 >= fmtlen || fmt[i + 1] != '?');
-		isset = (state.led_mask & (1 << (key == 'n')));
+		isset = (leds & (1 << (key == 'n')));
 
 		if (togglecase)
 			buf[n++] = isset ? toupper(key) : key;
@@ -2,10 +2,9 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
-#include <X11/XKBlib.h>
-#include <X11/Xlib.h>
 
 #include "../slstatus.h"
+#include "../source.h"
 #include "../util.h"
 
 static int
@@ -47,40 +46,17 @@ get_layout(char *syms, int grp_num)
 const char *
 keymap(const char *unused)
 {
-	Display *dpy;
-	XkbDescRec *desc;
-	XkbStateRec state;
-	char *symbols;
-	const char *layout;
+	const struct xkbstate *xkb;
+	char symbols[sizeof(xkb->symbols)];
+	int group;
 
-	layout = NULL;
-
-	if (!(dpy = XOpenDisplay(NULL))) {
-		warn("XOpenDisplay: Failed to open display");
+	if (!(xkb = getxkb())) {
+		putxkb();
 		return NULL;
 	}
-	if (!(desc = XkbAllocKeyboard())) {
-		warn("XkbAllocKeyboard: Failed to allocate keyboard");
-		goto end;
-	}
-	if (XkbGetNames(dpy, XkbSymbolsNameMask, desc)) {
-		warn("XkbGetNames: Failed to retrieve key symbols");
-		goto end;
-	}
-	if (XkbGetState(dpy, XkbUseCoreKbd, &state)) {
-		warn("XkbGetState: Failed to retrieve keyboard state");
-		goto end;
-	}
-	if (!(symbols = XGetAtomName(dpy, desc->names->symbols))) {
-		warn("XGetAtomName: Failed to get atom name");
-		goto end;
-	}
-	layout = bprintf("%s", get_layout(symbols, state.group));
-	XFree(symbols);
-end:
-	XkbFreeKeyboard(desc, XkbSymbolsNameMask, 1);
-	if (XCloseDisplay(dpy))
-		warn("XCloseDisplay: Failed to close display");
+	memcpy(symbols, xkb->symbols, sizeof(symbols));
+	group = xkb->group;
+	putxkb();
 
-	return layout;
+	return bprintf("%s", get_layout(symbols, group));
 }
@@ -1,11 +1,18 @@
 /* See LICENSE file for copyright and license details. */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <sensors/sensors.h>
 
 #include "../util.h"
 #include "../slstatus.h"
+#include "../source.h"
 
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
 
@@ -183,6 +190,281 @@ void collect() {
 	sensors_cleanup();
 }
 
+#if defined(__linux__)
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
+/*
+ * inputs of the known chips, found once under /sys/class/hwmon and then read
+ * with one pread each. they are looked for again when a hwmon device is added
+ * or removed, as told by the kernel's uevents, or when an input is gone.
+ * unlike libsensors this does not apply sensors.conf, its labels, compute
+ * and ignore statements only take effect on the libsensors fallback.
+ */
+typedef struct {
+	int fd;
+	int *sts;  /* field the value is folded into */
+	int scale; /* of the attribute, per unit shown */
+	int fan;
+} Input;
+
+static Input *inputs;
+static int ninputs, maxinputs; /* grown as chips have more */
+static int rescan = 1;
+static int ueventfd = -2;
+
+/* first line of a small sysfs attribute */
+static int read_attr(int dir, const char *name, char *b, size_t size) {
+	ssize_t n;
+	char *nl;
+	int fd;
+
+	if ((fd = openat(dir, name, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	n = read(fd, b, size - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	b[n] = '\0';
+	if ((nl = strchr(b, '\n')))
+		*nl = '\0';
+
+	return 0;
+}
+
+/* libsensors' name of the chip, prefix-bus-address */
+static void chip_name(int hwmon, const char *prefix, char *name, size_t size) {
+	char link[PATH_MAX];
+	const char *dev;
+	unsigned int domain, bus, slot, fn;
+	ssize_t n;
+
+	esnprintf(name, size, "%s", prefix);
+	if ((n = readlinkat(hwmon, "device", link, sizeof(link) - 1)) < 0)
+		return;
+	link[n] = '\0';
+	dev = (dev = strrchr(link, '/')) ? dev + 1 : link;
+	if (sscanf(dev, "%x:%x:%x.%x", &domain, &bus, &slot, &fn) == 4)
+		esnprintf(name, size, "%s-pci-%04x", prefix,
+		          (domain << 16) + (bus << 8) + (slot << 3) + fn);
+}
+
+/* the field of an input of the chip, NULL if not wanted */
+static int *input_sts(enum Chip chip, int dir, const char *attr, int *scale, int *fan) {
+	char label[64], name[32];
+	int n;
+	char c;
+
+	*fan = 0;
+	*scale = 1000;
+	if (sscanf(attr, "temp%d_inpu%c", &n, &c) == 2 && c == 't') {
+		label[0] = '\0';
+		if (esnprintf(name, sizeof(name), "temp%d_label", n) >= 0)
+			read_attr(dir, name, label, sizeof(label));
+		dbg(" %s %s\n", label, attr);
+
+		switch (chip) {
+			case amdgpu:
+				if (strcmp(label, "edge") == 0)
+					return &sts.amdgpuTempEdge;
+				if (strcmp(label, "junction") == 0)
+					return &sts.amdgpuTempJunction;
+				return NULL;
+			case k10Temp:
+				if (strcmp(label, "Tctl") == 0)
+					return &sts.k10tempTctl;
+				if (strcmp(label, "Tdie") == 0)
+					return &sts.k10tempTdie;
+				if (strcmp(label, "Tccd2") == 0)
+					return &sts.k10tempTccd2;
+				return NULL;
+			case coretemp:
+				return &sts.coreTemp;
+			default:
+				return NULL;
+		}
+	}
+	if (chip == thinkpad && sscanf(attr, "fan%d_inpu%c", &n, &c) == 2 && c == 't') {
+		*fan = 1;
+		*scale = 1;
+		return &sts.thinkpadFan;
+	}
+	if (chip == amdgpu && strcmp(attr, "power1_average") == 0) {
+		*scale = 1000000;
+		return &sts.amdgpuPowerAverage;
+	}
+
+	return NULL;
+}
+
+/* open the inputs of one hwmon device */
+static void scan_chip(int hwmon) {
+	char name[64], chip_print[128];
+	struct dirent *dp;
+	DIR *d;
+	enum Chip chip;
+	int *field, scale, fan, dir, fd;
+
+	/* older drivers keep the attributes with the device */
+	if (read_attr(hwmon, "name", name, sizeof(name)) == 0)
+		dir = dup(hwmon);
+	else if ((dir = openat(hwmon, "device", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ||
+	         read_attr(dir, "name", name, sizeof(name)) < 0) {
+		if (dir >= 0)
+			close(dir);
+		return;
+	}
+
+	chip_name(hwmon, name, chip_print, sizeof(chip_print));
+	dbg("%s %s\n", name, chip_print);
+	if ((strcmp(name, "amdgpu") == 0) && (strcmp(chip_print, EXT_AMDGPU_NAME) == 0))
+		chip = amdgpu;
+	else if (strcmp(name, "k10temp") == 0)
+		chip = k10Temp;
+	else if (strcmp(name, "thinkpad") == 0)
+		chip = thinkpad;
+	else if (strcmp(name, "coretemp") == 0)
+		chip = coretemp;
+	else {
+		close(dir);
+		return;
+	}
+
+	/* the stream owns a copy, the inputs are opened relative to dir */
+	if ((fd = dup(dir)) < 0 || !(d = fdopendir(fd))) {
+		if (fd >= 0)
+			close(fd);
+		close(dir);
+		return;
+	}
+	while ((dp = readdir(d))) {
+		if (!(field = input_sts(chip, dir, dp->d_name, &scale, &fan)))
+			continue;
+		if ((fd = openat(dir, dp->d_name, O_RDONLY | O_CLOEXEC)) < 0)
+			continue;
+		if (ninputs == maxinputs) {
+			Input *grown = realloc(inputs, (maxinputs ? maxinputs * 2 : 32) * sizeof(*inputs));
+
+			if (!grown) {
+				warn("realloc:");
+				close(fd);
+				break;
+			}
+			inputs = grown;
+			maxinputs = maxinputs ? maxinputs * 2 : 32;
+		}
+		inputs[ninputs++] = (Input){ fd, field, scale, fan };
+	}
+	closedir(d);
+	close(dir);
+}
+
+/* the watch of the uevents, from the main loop */
+static int read_uevents(int fd, void *unused) {
+	char b[8192];
+	ssize_t n;
+	int changed = 0;
+
+	for (;;) {
+		if ((n = recv(fd, b, sizeof(b) - 1, MSG_DONTWAIT)) < 0) {
+			if (errno == EINTR)
+				continue;
+			/* events were lost */
+			if (errno == ENOBUFS) {
+				changed = 1;
+				continue;
+			}
+			break;
+		}
+		b[n] = '\0';
+		if ((strncmp(b, "add@", 4) == 0 || strncmp(b, "remove@", 7) == 0) &&
+		    strstr(b, "/hwmon/hwmon"))
+			changed = 1;
+	}
+	if (changed)
+		__atomic_store_n(&rescan, 1, __ATOMIC_RELAXED);
+
+	return changed;
+}
+
+/* open the inputs of all known chips, -1 if there are none */
+static int scan_hwmon() {
+	struct sockaddr_nl sa;
+	char p[PATH_MAX];
+	const char *rp;
+	struct dirent *dp;
+	DIR *d;
+	int fd;
+
+	/* subscribe before the scan to miss nothing */
+	if (ueventfd == -2) {
+		memset(&sa, 0, sizeof(sa));
+		sa.nl_family = AF_NETLINK;
+		sa.nl_groups = 1;
+		if ((ueventfd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT)) >= 0 &&
+		    bind(ueventfd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+			close(ueventfd);
+			ueventfd = -1;
+		}
+	}
+
+	__atomic_store_n(&rescan, 0, __ATOMIC_RELAXED);
+	while (ninputs > 0)
+		close(inputs[--ninputs].fd);
+
+	if (!(rp = rootpath("/sys/class/hwmon", p, sizeof(p))) || !(d = opendir(rp)))
+		return -1;
+	while ((dp = readdir(d))) {
+		if (strncmp(dp->d_name, "hwmon", 5) != 0 ||
+		    (fd = openat(dirfd(d), dp->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+			continue;
+		scan_chip(fd);
+		close(fd);
+	}
+	closedir(d);
+
+	return ninputs ? 0 : -1;
+}
+
+/* collect from the hwmon inputs, -1 to fall back to libsensors */
+static int collect_hwmon() {
+	char b[32];
+	ssize_t n;
+	long value;
+	int i;
+
+	/* also makes the argument being evaluated depend on the uevents */
+	if (ueventfd >= 0 && watch(ueventfd, read_uevents, NULL) < 0)
+		read_uevents(ueventfd, NULL);
+	if (__atomic_load_n(&rescan, __ATOMIC_RELAXED) && scan_hwmon() < 0)
+		return -1;
+	if (!ninputs)
+		return -1;
+
+	zero_sts();
+	for (i = 0; i < ninputs; i++) {
+		if ((n = pread(inputs[i].fd, b, sizeof(b) - 1, 0)) < 0) {
+			/* the device is gone */
+			if (errno == ENODEV)
+				__atomic_store_n(&rescan, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		b[n] = '\0';
+		value = strtol(b, NULL, 10);
+		if (inputs[i].fan && (short)value == -1)
+			continue;
+		value = (value + inputs[i].scale / 2) / inputs[i].scale;
+		*inputs[i].sts = MAX(*inputs[i].sts, (int)value);
+	}
+
+	return 0;
+}
+#else
+static int collect_hwmon() {
+	return -1;
+}
+#endif
+
 /* render max stats as a string with a trailing newline */
 /* static buffer is returned, do not free */
 const char *render(const char *amdgpu) {
@@ -219,17 +501,19 @@ const char *render(const char *amdgpu) {
 const char *
 lm_sensors(const char *opts)
 {
-	static int invocation = 0;
+	static unsigned long gen;
 	static const char *output;
 
-	if (invocation == 0) {
-		collect();
+	unsigned long t = gettick();
+
+	/* once a tick, an interval of the argument spaces out libsensors */
+	if (gen != t) {
+		gen = t;
+		if (collect_hwmon() < 0)
+			collect();
 	}
 
 	output = render(strstr(opts, "amdgpu"));
 
-	if (++invocation >= 3)
-		invocation = 0;
-
 	return output;
 }
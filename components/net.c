@@ -8,26 +8,44 @@
 #define DOWN ""
 #define VPN_UP "│ VPN "
 
-const char *
-vpn_state(const char *interface)
-{
-	char *p;
-	char path[PATH_MAX];
-	FILE *fp;
-	char status[5];
-
-	if (esnprintf(path, sizeof(path), "/sys/class/net/%s/operstate", interface) < 0) {
-		return DOWN;
-	}
-	if (!(fp = fopen(path, "r"))) {
-		return DOWN;
-	}
-	p = fgets(status, 5, fp);
-	fclose(fp);
-	if (!p || strcmp(status, "up\n") != 0) {
-		return DOWN;
+#if defined(__linux__)
+	#include "../source.h"
+
+	/* from <linux/if.h>, which clashes with <net/if.h> */
+	#define IF_OPER_UP 6
+
+	const char *
+	vpn_state(const char *interface)
+	{
+		unsigned int flags;
+		unsigned char oper;
+
+		if (linkstate(interface, &flags, &oper) < 0 || oper != IF_OPER_UP)
+			return DOWN;
+
+		return VPN_UP;
 	}
+#else
+	const char *
+	vpn_state(const char *interface)
+	{
+		char *p;
+		char path[PATH_MAX];
+		FILE *fp;
+		char status[5];
 
-	return VPN_UP;
-}
+		if (esnprintf(path, sizeof(path), "/sys/class/net/%s/operstate", interface) < 0) {
+			return DOWN;
+		}
+		if (!(fp = rfopen(path, "r"))) {
+			return DOWN;
+		}
+		p = fgets(status, 5, fp);
+		fclose(fp);
+		if (!p || strcmp(status, "up\n") != 0) {
+			return DOWN;
+		}
 
+		return VPN_UP;
+	}
+#endif
@@ -8,49 +8,124 @@
 #if defined(__linux__)
 	#include <stdint.h>
 
-	#define NET_RX_BYTES "/sys/class/net/%s/statistics/rx_bytes"
-	#define NET_TX_BYTES "/sys/class/net/%s/statistics/tx_bytes"
+	#include "../source.h"
+
+	/*
+	 * change of a counter per second between the last two reads, none if
+	 * it went backwards as the link was reset or created again
+	 */
+	#define RATE(l, c) (((l)->cur.c < (l)->prev.c) ? 0 : \
+	                    ((l)->cur.c - (l)->prev.c) * 1000 / \
+	                    ((l)->tcur - (l)->tprev))
+
+	/* the link, if it was read twice */
+	static const struct link *
+	sampled(const char *interface)
+	{
+		const struct link *l;
+
+		if (!(l = getlink(interface)) || !l->tprev || l->tcur == l->tprev)
+			return NULL;
+
+		return l;
+	}
 
 	const char *
 	netspeed_rx(const char *interface)
 	{
-		uintmax_t oldrxbytes;
-		static uintmax_t rxbytes;
-		extern const unsigned int interval;
-		char path[PATH_MAX];
-
-		oldrxbytes = rxbytes;
+		const struct link *l;
+		uintmax_t rate;
 
-		if (esnprintf(path, sizeof(path), NET_RX_BYTES, interface) < 0)
-			return NULL;
-		if (pscanf(path, "%ju", &rxbytes) != 1)
-			return NULL;
-		if (oldrxbytes == 0)
+		if (!(l = sampled(interface))) {
+			putlinks();
 			return NULL;
+		}
+		rate = RATE(l, rx_bytes);
+		putlinks();
 
-		return fmt_human((rxbytes - oldrxbytes) * 1000 / interval,
-		                 1024);
+		return fmt_human(rate, 1024);
 	}
 
 	const char *
 	netspeed_tx(const char *interface)
 	{
-		uintmax_t oldtxbytes;
-		static uintmax_t txbytes;
-		extern const unsigned int interval;
-		char path[PATH_MAX];
+		const struct link *l;
+		uintmax_t rate;
 
-		oldtxbytes = txbytes;
+		if (!(l = sampled(interface))) {
+			putlinks();
+			return NULL;
+		}
+		rate = RATE(l, tx_bytes);
+		putlinks();
+
+		return fmt_human(rate, 1024);
+	}
+
+	const char *
+	netpackets_rx(const char *interface)
+	{
+		const struct link *l;
+		uintmax_t rate;
 
-		if (esnprintf(path, sizeof(path), NET_TX_BYTES, interface) < 0)
+		if (!(l = sampled(interface))) {
+			putlinks();
 			return NULL;
-		if (pscanf(path, "%ju", &txbytes) != 1)
+		}
+		rate = RATE(l, rx_packets);
+		putlinks();
+
+		return bprintf("%ju", rate);
+	}
+
+	const char *
+	netpackets_tx(const char *interface)
+	{
+		const struct link *l;
+		uintmax_t rate;
+
+		if (!(l = sampled(interface))) {
+			putlinks();
 			return NULL;
-		if (oldtxbytes == 0)
+		}
+		rate = RATE(l, tx_packets);
+		putlinks();
+
+		return bprintf("%ju", rate);
+	}
+
+	const char *
+	net_errors(const char *interface)
+	{
+		const struct link *l;
+		uintmax_t rx, tx;
+
+		if (!(l = getlink(interface))) {
+			putlinks();
 			return NULL;
+		}
+		rx = l->cur.rx_errors;
+		tx = l->cur.tx_errors;
+		putlinks();
 
-		return fmt_human((txbytes - oldtxbytes) * 1000 / interval,
-		                 1024);
+		return bprintf("%ju/%ju", rx, tx);
+	}
+
+	const char *
+	net_drops(const char *interface)
+	{
+		const struct link *l;
+		uintmax_t rx, tx;
+
+		if (!(l = getlink(interface))) {
+			putlinks();
+			return NULL;
+		}
+		rx = l->cur.rx_dropped;
+		tx = l->cur.tx_dropped;
+		putlinks();
+
+		return bprintf("%ju/%ju", rx, tx);
 	}
 #elif defined(__OpenBSD__) | defined(__FreeBSD__)
 	#include <ifaddrs.h>
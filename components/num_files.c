@@ -1,32 +1,236 @@
 /* See LICENSE file for copyright and license details. */
 #include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "../slstatus.h"
 #include "../util.h"
 
-const char *
-num_files(const char *path)
-{
-	struct dirent *dp;
-	DIR *dir;
-	int num;
+#if defined(__linux__)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <pthread.h>
+	#include <stdint.h>
+	#include <stdlib.h>
+	#include <sys/inotify.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
 
-	if (!(dir = opendir(path))) {
-		warn("opendir '%s':", path);
-		return NULL;
+	/*
+	 * a directory is counted once with getdents64(2), then entries created,
+	 * deleted or moved are added or taken from the count as inotify tells.
+	 * it is counted again when events were lost or raced the count. without
+	 * the main loop the events are read on every call.
+	 */
+	#define DENTSIZE (1 << 20)
+
+	struct linux_dirent64 {
+		uint64_t d_ino;
+		int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[];
+	};
+
+	static struct count {
+		const char *path;
+		int fd;           /* inotify instance, -1 if none */
+		int watched, stale;
+		long num;         /* -1 if unknown */
+	} counts[8];
+
+	static pthread_mutex_t countlock = PTHREAD_MUTEX_INITIALIZER;
+
+	static long
+	scan(const char *path)
+	{
+		struct linux_dirent64 *d;
+		char p[PATH_MAX], *b;
+		const char *rp;
+		long num, len, off;
+		int fd;
+
+		if (!(rp = rootpath(path, p, sizeof(p))) ||
+		    (fd = open(rp, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+			warn("open '%s':", path);
+			return -1;
+		}
+		if (!(b = malloc(DENTSIZE))) {
+			warn("malloc:");
+			close(fd);
+			return -1;
+		}
+
+		num = 0;
+		while ((len = syscall(SYS_getdents64, fd, b, DENTSIZE)) > 0) {
+			for (off = 0; off < len; off += d->d_reclen) {
+				d = (struct linux_dirent64 *)(b + off);
+				/* skip self and parent */
+				if (d->d_name[0] == '.' && (!d->d_name[1] ||
+				    (d->d_name[1] == '.' && !d->d_name[2])))
+					continue;
+				num++;
+			}
+		}
+		if (len < 0) {
+			warn("getdents64 '%s':", path);
+			num = -1;
+		}
+		free(b);
+		close(fd);
+
+		return num;
 	}
 
-	num = 0;
-	while ((dp = readdir(dir))) {
-		if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
-			continue; /* skip self and parent */
+	/* apply the pending events, returns 1 if the count changed */
+	static int
+	readevents(struct count *c)
+	{
+		char b[16384]
+			__attribute__((aligned(__alignof__(struct inotify_event))));
+		const struct inotify_event *e;
+		ssize_t len;
+		char *p;
+		int changed, gone;
 
-		num++;
+		for (changed = gone = 0;;) {
+			if ((len = read(c->fd, b, sizeof(b))) < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (p = b; p < b + len; p += sizeof(*e) + e->len) {
+				e = (const struct inotify_event *)p;
+				/* an unknown count is left to the recount */
+				if (e->mask & (IN_CREATE | IN_MOVED_TO))
+					c->num += (c->num >= 0);
+				else if (e->mask & (IN_DELETE | IN_MOVED_FROM))
+					c->num -= (c->num >= 0);
+				else if (e->mask & IN_Q_OVERFLOW)
+					c->stale = 1;
+				else if (e->mask & (IN_IGNORED | IN_MOVE_SELF))
+					gone = 1;
+				changed = 1;
+			}
+		}
+
+		/* the path is no longer the directory, watch it again */
+		if (gone) {
+			unwatch(c->fd);
+			close(c->fd);
+			c->fd = -1;
+			c->watched = 0;
+		}
+
+		return changed;
 	}
 
-	closedir(dir);
+	/* the watch of the directory, from the main loop */
+	static int
+	readcount(int fd, void *data)
+	{
+		int changed;
+
+		pthread_mutex_lock(&countlock);
+		changed = readevents(data);
+		pthread_mutex_unlock(&countlock);
+
+		return changed;
+	}
+
+	static void
+	recount(struct count *c)
+	{
+		char p[PATH_MAX];
+		const char *rp;
+
+		if (c->fd < 0) {
+			c->watched = 0;
+			if ((c->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+				warn("inotify_init1:");
+			} else if (!(rp = rootpath(c->path, p, sizeof(p))) ||
+			           inotify_add_watch(c->fd, rp, IN_CREATE |
+			                             IN_DELETE | IN_MOVED_FROM |
+			                             IN_MOVED_TO | IN_MOVE_SELF |
+			                             IN_ONLYDIR) < 0) {
+				close(c->fd);
+				c->fd = -1;
+			}
+		}
 
-	return bprintf("%d", num);
-}
+		/* events up to now are in the count, later ones race it */
+		if (c->fd >= 0)
+			readevents(c);
+		c->num = scan(c->path);
+		c->stale = (c->fd >= 0 && readevents(c));
+	}
+
+	const char *
+	num_files(const char *path)
+	{
+		struct count *c;
+		size_t i;
+		long num;
+
+		pthread_mutex_lock(&countlock);
+		for (i = 0; i < LEN(counts) && counts[i].path &&
+		     strcmp(counts[i].path, path); i++)
+			;
+		if (i == LEN(counts)) {
+			pthread_mutex_unlock(&countlock);
+			warn("num_files: Too many directories");
+			return NULL;
+		}
+		c = &counts[i];
+		if (!c->path) {
+			c->path = path;
+			c->fd = -1;
+		}
+
+		/* also makes the argument being evaluated depend on it */
+		if (c->fd >= 0 && watch(c->fd, readcount, c) == 0)
+			c->watched = 1;
+		if (c->fd >= 0 && !c->watched)
+			readevents(c);
+		if (c->fd < 0 || c->stale || c->num < 0) {
+			recount(c);
+			if (c->fd >= 0 && watch(c->fd, readcount, c) == 0)
+				c->watched = 1;
+		}
+		num = c->num;
+		pthread_mutex_unlock(&countlock);
+
+		if (num < 0)
+			return NULL;
+
+		return bprintf("%ld", num);
+	}
+#else
+	const char *
+	num_files(const char *path)
+	{
+		struct dirent *dp;
+		DIR *dir;
+		int num;
+		char p[PATH_MAX];
+		const char *rp;
+
+		if (!(rp = rootpath(path, p, sizeof(p))) || !(dir = opendir(rp))) {
+			warn("opendir '%s':", path);
+			return NULL;
+		}
+
+		num = 0;
+		while ((dp = readdir(dir))) {
+			if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
+				continue; /* skip self and parent */
+
+			num++;
+		}
+
+		closedir(dir);
+
+		return bprintf("%d", num);
+	}
+#endif
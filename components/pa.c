@@ -1,19 +1,37 @@
 /* See LICENSE file for copyright and license details. */
 #include <math.h>
-#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "../slstatus.h"
 #include "../util.h"
 
 #include <pulse/pulseaudio.h>
 
 #define PA_SUBSCRIPTIONS PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE | PA_SUBSCRIPTION_MASK_SERVER
 
-struct state {
+#define PA_NAME_LEN 256
+
+// delay before reconnecting to the server (in ms)
+#define BACKOFF_MIN 1000
+#define BACKOFF_MAX 60000
+
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+
+// flags a struct timeval of the monotonic clock, as libpulse does
+#define PA_TIMEVAL_RTCLOCK ((time_t)(1LL << 30))
+
+// what is shown
+struct snapshot {
 	bool available;
 
 	int src_perc;
@@ -21,13 +39,19 @@ struct state {
 
 	bool other_unmuted_srcs;
 	bool other_unmuted_sinks;
+};
+
+// owned by the pulse event loop
+struct state {
+	struct snapshot v;
 
-	char *sink_def;
-	char *src_def;
+	char sink_def[PA_NAME_LEN];
+	char src_def[PA_NAME_LEN];
 };
 
 int calc_perc(pa_cvolume volume, bool mute);
 void reset_state(struct state *s);
+int state_changed(const struct state *s);
 void source_info_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata);
 void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata);
 void server_info_cb(pa_context *c, const pa_server_info *i, void *userdata);
@@ -51,22 +75,28 @@ void reset_state(struct state *s) {
 		return;
 	}
 
-	s->available = false;
+	s->v.available = false;
 
-	s->src_perc = 0;
-	s->sink_perc = 0;
+	s->v.src_perc = 0;
+	s->v.sink_perc = 0;
 
-	s->other_unmuted_srcs = false;
-	s->other_unmuted_sinks = false;
+	s->v.other_unmuted_srcs = false;
+	s->v.other_unmuted_sinks = false;
 
-	if (s->sink_def) {
-		free(s->sink_def);
-	}
-	s->sink_def = NULL;
-	if (s->src_def) {
-		free(s->src_def);
+	s->sink_def[0] = '\0';
+	s->src_def[0] = '\0';
+}
+
+// returns 1 if what is shown changed since the last call
+int state_changed(const struct state *s) {
+	static struct snapshot last;
+
+	if (memcmp(&last, &s->v, sizeof(last)) == 0) {
+		return 0;
 	}
-	s->src_def = NULL;
+	last = s->v;
+
+	return 1;
 }
 
 void source_info_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
@@ -77,10 +107,10 @@ void source_info_cb(pa_context *c, const pa_source_info *i, int eol, void *userd
 	if (!i) {
 		return;
 	}
-	if (s->src_def && strcmp(i->name, s->src_def) == 0) {
-		s->src_perc = calc_perc(i->volume, i->mute);
+	if (s->src_def[0] && strcmp(i->name, s->src_def) == 0) {
+		s->v.src_perc = calc_perc(i->volume, i->mute);
 	} else if (!i->mute) {
-		s->other_unmuted_srcs = true;
+		s->v.other_unmuted_srcs = true;
 	}
 }
 
@@ -92,10 +122,10 @@ void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata)
 	if (!i) {
 		return;
 	}
-	if (s->sink_def && strcmp(i->name, s->sink_def) == 0) {
-		s->sink_perc = calc_perc(i->volume, i->mute);
+	if (s->sink_def[0] && strcmp(i->name, s->sink_def) == 0) {
+		s->v.sink_perc = calc_perc(i->volume, i->mute);
 	} else if (!i->mute) {
-		s->other_unmuted_sinks = true;
+		s->v.other_unmuted_sinks = true;
 	}
 }
 
@@ -105,14 +135,8 @@ void server_info_cb(pa_context *c, const pa_server_info *i, void *userdata) {
 		return;
 	}
 
-	if (s->sink_def) {
-		free(s->sink_def);
-	}
-	if (s->src_def) {
-		free(s->src_def);
-	}
-	s->sink_def = strdup(i->default_sink_name);
-	s->src_def = strdup(i->default_source_name);
+	snprintf(s->sink_def, sizeof(s->sink_def), "%s", i->default_sink_name ? i->default_sink_name : "");
+	snprintf(s->src_def, sizeof(s->src_def), "%s", i->default_source_name ? i->default_source_name : "");
 
 	// (re)discover volumes
 	subscribe_cb(c, PA_SUBSCRIPTION_EVENT_SINK, 0, s);
@@ -125,11 +149,11 @@ void subscribe_cb(pa_context *c, pa_subscription_event_type_t type, uint32_t ind
 	struct state *s = userdata;
 	switch (type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) {
 		case PA_SUBSCRIPTION_EVENT_SINK:
-			s->other_unmuted_sinks = false;
+			s->v.other_unmuted_sinks = false;
 			pa_context_get_sink_info_list(c, sink_info_cb, userdata);
 			break;
 		case PA_SUBSCRIPTION_EVENT_SOURCE:
-			s->other_unmuted_srcs = false;
+			s->v.other_unmuted_srcs = false;
 			pa_context_get_source_info_list(c, source_info_cb, userdata);
 			break;
 		case PA_SUBSCRIPTION_EVENT_SERVER:
@@ -140,95 +164,434 @@ void subscribe_cb(pa_context *c, pa_subscription_event_type_t type, uint32_t ind
 	}
 }
 
-void *pa_loop(void *data) {
-	struct state *s = data;
-
-	for (;;) {
-		pa_mainloop *mainloop = pa_mainloop_new();
-		pa_mainloop_api *mainloop_api = pa_mainloop_get_api(mainloop);
-
-		// context will block inner loop until PA is available
-		pa_context *context = pa_context_new(mainloop_api, "slstatus");
-		pa_context_connect(context, NULL, PA_CONTEXT_NOFAIL, NULL);
-		pa_context_set_subscribe_callback(context, subscribe_cb, s);
-
-		bool first_run = true;
-		bool fail_or_terminate = false;
-		for (;;) {
-			switch (pa_context_get_state(context)) {
-				case PA_CONTEXT_UNCONNECTED:
-				case PA_CONTEXT_CONNECTING:
-				case PA_CONTEXT_AUTHORIZING:
-				case PA_CONTEXT_SETTING_NAME:
-				default:
-					pa_mainloop_iterate(mainloop, 1, NULL);
-					continue;
-					break;
-				case PA_CONTEXT_FAILED:
-				case PA_CONTEXT_TERMINATED:
-					fail_or_terminate = true;
-					break;
-				case PA_CONTEXT_READY:
-					s->available = true;
-					break;
-			}
-			if (fail_or_terminate)
-				break;
+/*
+ * pa_mainloop_api on an epoll fd of its own, which the main loop watches:
+ * io events are its fds, the time events share a timerfd and enabled defer
+ * events keep an eventfd readable. without the main loop pa() dispatches.
+ */
+struct pa_io_event {
+	int fd;
+	pa_io_event_cb_t cb;
+	pa_io_event_destroy_cb_t destroy;
+	void *userdata;
+	bool dead;
+	struct pa_io_event *next;
+};
 
-			if (first_run) {
-				first_run = false;
-				pa_context_subscribe(context, PA_SUBSCRIPTIONS, NULL, s);
+struct pa_time_event {
+	uint64_t at; // monotonic, in us; 0 if disabled
+	pa_time_event_cb_t cb;
+	pa_time_event_destroy_cb_t destroy;
+	void *userdata;
+	bool dead;
+	struct pa_time_event *next;
+};
 
-				// discover defaults; will start a volume query
-				pa_context_get_server_info(context, server_info_cb, s);
-			}
+struct pa_defer_event {
+	bool enabled;
+	pa_defer_event_cb_t cb;
+	pa_defer_event_destroy_cb_t destroy;
+	void *userdata;
+	bool dead;
+	struct pa_defer_event *next;
+};
+
+static pa_mainloop_api api;
+static int loop_fd = -1, timer_fd = -1, defer_fd = -1;
+static pa_io_event *ios;
+static pa_time_event *times;
+static pa_defer_event *defers;
+static bool have_dead;
+
+static struct state state;
+static pa_context *context;
+static pa_time_event *retry;
+static unsigned int backoff = BACKOFF_MIN;
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// a time of libpulse, flagged if it is of the monotonic clock
+static uint64_t to_us(const struct timeval *tv) {
+	struct timeval wall;
+	uint64_t t;
+
+	if (tv->tv_usec & PA_TIMEVAL_RTCLOCK) {
+		return (uint64_t)tv->tv_sec * 1000000 + (tv->tv_usec & ~PA_TIMEVAL_RTCLOCK);
+	}
+
+	gettimeofday(&wall, NULL);
+	t = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	return now_us() + t - MIN(t, (uint64_t)wall.tv_sec * 1000000 + wall.tv_usec);
+}
 
-			pa_mainloop_iterate(mainloop, 1, NULL);
+static uint32_t io_epoll(pa_io_event_flags_t events) {
+	return (events & PA_IO_EVENT_INPUT ? EPOLLIN : 0) |
+		(events & PA_IO_EVENT_OUTPUT ? EPOLLOUT : 0);
+}
+
+static pa_io_event_flags_t io_flags(uint32_t events) {
+	return (events & EPOLLIN ? PA_IO_EVENT_INPUT : 0) |
+		(events & EPOLLOUT ? PA_IO_EVENT_OUTPUT : 0) |
+		(events & EPOLLHUP ? PA_IO_EVENT_HANGUP : 0) |
+		(events & EPOLLERR ? PA_IO_EVENT_ERROR : 0);
+}
+
+static pa_io_event *io_new(pa_mainloop_api *a, int fd, pa_io_event_flags_t events, pa_io_event_cb_t cb, void *userdata) {
+	pa_io_event *e;
+	struct epoll_event ev = { 0 };
+
+	if (!(e = calloc(1, sizeof(*e)))) {
+		return NULL;
+	}
+	e->fd = fd;
+	e->cb = cb;
+	e->userdata = userdata;
+
+	ev.events = io_epoll(events);
+	ev.data.ptr = e;
+	if (epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		warn("epoll_ctl '%d':", fd);
+		free(e);
+		return NULL;
+	}
+	e->next = ios;
+	ios = e;
+
+	return e;
+}
+
+static void io_enable(pa_io_event *e, pa_io_event_flags_t events) {
+	struct epoll_event ev = { 0 };
+
+	ev.events = io_epoll(events);
+	ev.data.ptr = e;
+	epoll_ctl(loop_fd, EPOLL_CTL_MOD, e->fd, &ev);
+}
+
+static void io_free(pa_io_event *e) {
+	epoll_ctl(loop_fd, EPOLL_CTL_DEL, e->fd, NULL);
+	e->dead = have_dead = true;
+}
+
+static void io_set_destroy(pa_io_event *e, pa_io_event_destroy_cb_t cb) {
+	e->destroy = cb;
+}
+
+// arm the timerfd for the earliest time event
+static void time_arm(void) {
+	struct itimerspec its = { 0 };
+	pa_time_event *e;
+	uint64_t at = 0;
+
+	for (e = times; e; e = e->next) {
+		if (!e->dead && e->at && (!at || e->at < at)) {
+			at = e->at;
 		}
-		reset_state(s);
+	}
+	its.it_value.tv_sec = at / 1000000;
+	its.it_value.tv_nsec = at % 1000000 * 1000;
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static pa_time_event *time_new(pa_mainloop_api *a, const struct timeval *tv, pa_time_event_cb_t cb, void *userdata) {
+	pa_time_event *e;
+
+	if (!(e = calloc(1, sizeof(*e)))) {
+		return NULL;
+	}
+	e->at = tv ? MAX(to_us(tv), 1) : 0;
+	e->cb = cb;
+	e->userdata = userdata;
+	e->next = times;
+	times = e;
+	time_arm();
+
+	return e;
+}
+
+static void time_restart(pa_time_event *e, const struct timeval *tv) {
+	e->at = tv ? MAX(to_us(tv), 1) : 0;
+	time_arm();
+}
+
+static void time_free(pa_time_event *e) {
+	e->dead = have_dead = true;
+	time_arm();
+}
+
+static void time_set_destroy(pa_time_event *e, pa_time_event_destroy_cb_t cb) {
+	e->destroy = cb;
+}
 
-		// pa is very leaky; best effort here
-		if (context) {
-			pa_context_disconnect(context);
-			pa_context_unref(context);
+static pa_defer_event *defer_new(pa_mainloop_api *a, pa_defer_event_cb_t cb, void *userdata) {
+	pa_defer_event *e;
+
+	if (!(e = calloc(1, sizeof(*e)))) {
+		return NULL;
+	}
+	e->enabled = true;
+	e->cb = cb;
+	e->userdata = userdata;
+	e->next = defers;
+	defers = e;
+	eventfd_write(defer_fd, 1);
+
+	return e;
+}
+
+static void defer_enable(pa_defer_event *e, int b) {
+	if ((e->enabled = b)) {
+		eventfd_write(defer_fd, 1);
+	}
+}
+
+static void defer_free(pa_defer_event *e) {
+	e->dead = have_dead = true;
+}
+
+static void defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy_cb_t cb) {
+	e->destroy = cb;
+}
+
+static void quit(pa_mainloop_api *a, int retval) {
+}
+
+// free the events freed during a dispatch
+static void collect_dead(void) {
+	pa_io_event *io, **pio;
+	pa_time_event *t, **pt;
+	pa_defer_event *d, **pd;
+
+	have_dead = false;
+	for (pio = &ios; (io = *pio);) {
+		if (!io->dead) {
+			pio = &io->next;
+			continue;
+		}
+		*pio = io->next;
+		if (io->destroy)
+			io->destroy(&api, io, io->userdata);
+		free(io);
+	}
+	for (pt = &times; (t = *pt);) {
+		if (!t->dead) {
+			pt = &t->next;
+			continue;
 		}
-		if (mainloop) {
-			pa_mainloop_free(mainloop);
+		*pt = t->next;
+		if (t->destroy)
+			t->destroy(&api, t, t->userdata);
+		free(t);
+	}
+	for (pd = &defers; (d = *pd);) {
+		if (!d->dead) {
+			pd = &d->next;
+			continue;
+		}
+		*pd = d->next;
+		if (d->destroy)
+			d->destroy(&api, d, d->userdata);
+		free(d);
+	}
+}
+
+// the watch of loop_fd, from the main loop
+static int dispatch(int fd, void *data) {
+	(void)data;
+
+	struct epoll_event ev[16];
+	pa_io_event *io;
+	pa_time_event *t;
+	pa_defer_event *d;
+	struct timeval tv;
+	uint64_t now, expirations;
+	eventfd_t n;
+	bool pending;
+	int i, nev;
+
+	nev = epoll_wait(fd, ev, LEN(ev), 0);
+	for (i = 0; i < nev; i++) {
+		if (ev[i].data.ptr == &timer_fd) {
+			if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+				;
+			}
+		} else if (ev[i].data.ptr != &defer_fd) {
+			io = ev[i].data.ptr;
+			if (!io->dead)
+				io->cb(&api, io, io->fd, io_flags(ev[i].events), io->userdata);
 		}
 	}
 
-	return NULL;
+	now = now_us();
+	for (t = times; t; t = t->next) {
+		if (t->dead || !t->at || t->at > now)
+			continue;
+		tv.tv_sec = t->at / 1000000;
+		tv.tv_usec = (t->at % 1000000) | PA_TIMEVAL_RTCLOCK;
+		t->at = 0;
+		t->cb(&api, t, &tv, t->userdata);
+	}
+
+	for (d = defers; d; d = d->next) {
+		if (!d->dead && d->enabled)
+			d->cb(&api, d, d->userdata);
+	}
+
+	if (have_dead)
+		collect_dead();
+	time_arm();
+
+	// keep defer_fd readable while a defer event is enabled
+	eventfd_read(defer_fd, &n);
+	for (pending = false, d = defers; d && !pending; d = d->next) {
+		pending = !d->dead && d->enabled;
+	}
+	if (pending)
+		eventfd_write(defer_fd, 1);
+
+	return state_changed(&state);
+}
+
+static int loop_init(void) {
+	struct epoll_event ev = { 0 };
+
+	api.io_new = io_new;
+	api.io_enable = io_enable;
+	api.io_free = io_free;
+	api.io_set_destroy = io_set_destroy;
+	api.time_new = time_new;
+	api.time_restart = time_restart;
+	api.time_free = time_free;
+	api.time_set_destroy = time_set_destroy;
+	api.defer_new = defer_new;
+	api.defer_enable = defer_enable;
+	api.defer_free = defer_free;
+	api.defer_set_destroy = defer_set_destroy;
+	api.quit = quit;
+
+	if ((loop_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+			(timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+			(defer_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		warn("pa: event loop:");
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &timer_fd;
+	epoll_ctl(loop_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+	ev.data.ptr = &defer_fd;
+	epoll_ctl(loop_fd, EPOLL_CTL_ADD, defer_fd, &ev);
+
+	return 0;
+}
+
+static void pulse_connect(void);
+
+static void retry_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+	a->time_free(e);
+	retry = NULL;
+	pulse_connect();
+}
+
+// try again later, backing off while the server stays away
+static void pulse_retry(void) {
+	struct timeval tv;
+	uint64_t at;
+
+	reset_state(&state);
+	if (retry)
+		return;
+
+	at = now_us() + (uint64_t)backoff * 1000;
+	tv.tv_sec = at / 1000000;
+	tv.tv_usec = (at % 1000000) | PA_TIMEVAL_RTCLOCK;
+	retry = api.time_new(&api, &tv, retry_cb, NULL);
+	backoff = MIN(backoff * 2, BACKOFF_MAX);
+}
+
+static void state_cb(pa_context *c, void *userdata) {
+	switch (pa_context_get_state(c)) {
+		case PA_CONTEXT_READY:
+			backoff = BACKOFF_MIN;
+			state.v.available = true;
+			pa_context_subscribe(c, PA_SUBSCRIPTIONS, NULL, &state);
+
+			// discover defaults; will start a volume query
+			pa_context_get_server_info(c, server_info_cb, &state);
+			break;
+		case PA_CONTEXT_FAILED:
+		case PA_CONTEXT_TERMINATED:
+			pulse_retry();
+			break;
+		default:
+			break;
+	}
+}
+
+static void pulse_connect(void) {
+	// pa is very leaky; best effort here
+	if (context) {
+		pa_context_set_state_callback(context, NULL, NULL);
+		pa_context_disconnect(context);
+		pa_context_unref(context);
+	}
+
+	if (!(context = pa_context_new(&api, "slstatus"))) {
+		pulse_retry();
+		return;
+	}
+	pa_context_set_state_callback(context, state_cb, NULL);
+	pa_context_set_subscribe_callback(context, subscribe_cb, &state);
+	if (pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		pulse_retry();
 }
 
 const char *pa(const char *unused) {
-	static struct state s = { 0 };
 	static char b[1024];
-	static pthread_t pa_thread = 0;
-
-	if (!pa_thread) {
-		reset_state(&s);
-		pthread_create(&pa_thread, NULL, &pa_loop, &s);
-		return "";
+	static bool init, watched;
+	struct snapshot v;
+
+	if (!init) {
+		init = true;
+		reset_state(&state);
+		if (loop_init() < 0)
+			return NULL;
+		pulse_connect();
 	}
+	if (loop_fd < 0)
+		return NULL;
+
+	// redraw as soon as the state changes
+	if (watch(loop_fd, dispatch, NULL) == 0)
+		watched = true;
+	if (!watched)
+		dispatch(loop_fd, NULL);
+
+	// the loop runs on this thread, the state is read as it is
+	v = state.v;
 
 	char *bp = b;
 	*bp = '\0';
 
-	if (s.available) {
-		if (s.other_unmuted_srcs)
+	if (v.available) {
+		if (v.other_unmuted_srcs)
 			bp += sprintf(bp, "║ Non-default Microphones Are Active ║ ");
 
-		if (s.src_perc > 0) {
-			bp += sprintf(bp, "│ M %d%% ", s.src_perc);
+		if (v.src_perc > 0) {
+			bp += sprintf(bp, "│ M %d%% ", v.src_perc);
 		}
 
-		if (s.sink_perc == -1) {
+		if (v.sink_perc == -1) {
 			bp += sprintf(bp, "│ S Mute ");
-		} else if (s.sink_perc != 100) {
-			bp += sprintf(bp, "│ S %d%% ", s.sink_perc);
+		} else if (v.sink_perc != 100) {
+			bp += sprintf(bp, "│ S %d%% ", v.sink_perc);
 		}
 	}
 
 	return b;
 }
-
@@ -1,6 +1,12 @@
 /* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "../slstatus.h"
 #include "../util.h"
@@ -10,15 +16,22 @@ run_command(const char *cmd)
 {
 	char *p;
 	FILE *fp;
+	pid_t pid;
+	int fd;
 
-	if (!(fp = popen(cmd, "r"))) {
-		warn("popen '%s':", cmd);
+	if ((pid = spawn(cmd, &fd)) < 0)
+		return NULL;
+	if (!(fp = fdopen(fd, "r"))) {
+		warn("fdopen '%s':", cmd);
+		close(fd);
+		waitpid(pid, NULL, 0);
 		return NULL;
 	}
 
 	p = fgets(buf, sizeof(buf) - 1, fp);
-	if (pclose(fp) < 0) {
-		warn("pclose '%s':", cmd);
+	fclose(fp);
+	if (waitpid(pid, NULL, 0) < 0) {
+		warn("waitpid '%s':", cmd);
 		return NULL;
 	}
 	if (!p)
@@ -29,3 +42,132 @@ run_command(const char *cmd)
 
 	return buf[0] ? buf : NULL;
 }
+
+struct command {
+	const char *cmd;
+	pid_t pid, pgid;
+	int fd;
+	uintmax_t started; /* in ms */
+	size_t len;
+	char line[1024];
+	char out[1024];
+};
+
+static void
+closecmd(struct command *c)
+{
+	unwatch(c->fd);
+	close(c->fd);
+	c->fd = -1;
+}
+
+static void
+reap(struct command *c, int options)
+{
+	pid_t r;
+
+	if ((r = waitpid(c->pid, NULL, options)) < 0)
+		warn("waitpid '%s':", c->cmd);
+	/* the group id is free for reuse from now on */
+	if (r != 0)
+		c->pid = c->pgid = -1;
+}
+
+static int
+readcmd(int fd, void *data)
+{
+	struct command *c = data;
+	ssize_t r;
+	char tmp[256], *p;
+
+	for (;;) {
+		if (c->len < sizeof(c->line) - 1)
+			r = read(c->fd, c->line + c->len,
+			         sizeof(c->line) - 1 - c->len);
+		else
+			r = read(c->fd, tmp, sizeof(tmp));
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 && errno == EAGAIN)
+			return 0; /* the rest is still to come */
+		if (r < 0) {
+			warn("read '%s':", c->cmd);
+			closecmd(c);
+			return 0;
+		}
+		if (r == 0)
+			break;
+		if (c->len < sizeof(c->line) - 1)
+			c->len += r;
+	}
+
+	/* the first line of the output replaces the previous result */
+	c->line[c->len] = '\0';
+	if ((p = strchr(c->line, '\n')))
+		p[0] = '\0';
+	memcpy(c->out, c->line, sizeof(c->out));
+	closecmd(c);
+	reap(c, WNOHANG);
+
+	return 1;
+}
+
+/*
+ * like run_command, but the command runs in the background and its output
+ * is read by the main loop. the previous output is shown until the command
+ * exits. it is killed with its process group once it or a child holding
+ * its output runs longer than run_timeout, checked each time the argument
+ * is due, and not run more often than every run_period. it is only reaped
+ * after its output is closed, so that its group id stays reserved for the
+ * kill until then.
+ */
+const char *
+run_command_async(const char *cmd)
+{
+	static struct command cmds[8];
+	extern const unsigned int run_timeout, run_period;
+	struct command *c;
+	uintmax_t now;
+	size_t i;
+
+	for (i = 0; i < LEN(cmds) && cmds[i].cmd &&
+	     strcmp(cmds[i].cmd, cmd); i++)
+		;
+	if (i == LEN(cmds)) {
+		warn("run_command_async: Too many commands");
+		return NULL;
+	}
+	c = &cmds[i];
+	if (!c->cmd) {
+		c->cmd = cmd;
+		c->pid = c->fd = -1;
+	}
+
+	/* without a watch, poll for the output */
+	if (c->fd >= 0)
+		readcmd(c->fd, c);
+	if (c->pid > 0 && c->fd < 0)
+		reap(c, WNOHANG);
+
+	now = monotonic();
+	if (c->pid > 0 && now - c->started >= run_timeout) {
+		warn("run_command_async '%s': Timed out", cmd);
+		if (c->fd >= 0)
+			closecmd(c);
+		if (c->pgid > 0)
+			kill(-c->pgid, SIGKILL);
+		reap(c, 0);
+	} else if (c->pid < 0 && c->fd < 0 &&
+	           (!c->started || now - c->started >= run_period)) {
+		if ((c->pid = spawn(cmd, &c->fd)) > 0) {
+			c->pgid = c->pid;
+			c->started = now;
+			c->len = 0;
+			fcntl(c->fd, F_SETFL, O_NONBLOCK);
+			watch(c->fd, readcmd, c);
+		}
+	}
+
+	return c->out[0] ? c->out : NULL;
+}
@@ -15,247 +15,85 @@
 			(2 * (rssi + 100)))
 
 #if defined(__linux__)
-	#include <stdint.h>
-	#include <net/if.h>
-	#include <linux/netlink.h>
-	#include <linux/genetlink.h>
-	#include <linux/nl80211.h>
-
-	static int nlsock = -1;
-	static uint32_t seq = 1;
-	static char resp[4096];
+	#include "../source.h"
 
-	static char *
-	findattr(int attr, const char *p, const char *e, size_t *len)
+	const char *
+	wifi_essid(const char *interface)
 	{
-		while (p < e) {
-			struct nlattr nla;
-			memcpy(&nla, p, sizeof(nla));
-			if (nla.nla_type == attr) {
-				*len = nla.nla_len - NLA_HDRLEN;
-				return (char *)(p + NLA_HDRLEN);
-			}
-			p += NLA_ALIGN(nla.nla_len);
-		}
-		return NULL;
-	}
+		const struct station *s;
+		char ssid[sizeof(s->ssid)];
 
-	static uint16_t
-	nl80211fam(void)
-	{
-		static const char family[] = "nl80211";
-		static uint16_t id;
-		ssize_t r;
-		size_t len;
-		char ctrl[NLMSG_HDRLEN+GENL_HDRLEN+NLA_HDRLEN+NLA_ALIGN(sizeof(family))] = {0}, *p = ctrl;
-
-		if (id)
-			return id;
-
-		memcpy(p, &(struct nlmsghdr){
-			.nlmsg_len = sizeof(ctrl),
-			.nlmsg_type = GENL_ID_CTRL,
-			.nlmsg_flags = NLM_F_REQUEST,
-			.nlmsg_seq = seq++,
-			.nlmsg_pid = 0,
-		}, sizeof(struct nlmsghdr));
-		p += NLMSG_HDRLEN;
-		memcpy(p, &(struct genlmsghdr){
-			.cmd = CTRL_CMD_GETFAMILY,
-			.version = 1,
-		}, sizeof(struct genlmsghdr));
-		p += GENL_HDRLEN;
-		memcpy(p, &(struct nlattr){
-			.nla_len = NLA_HDRLEN+sizeof(family),
-			.nla_type = CTRL_ATTR_FAMILY_NAME,
-		}, sizeof(struct nlattr));
-		p += NLA_HDRLEN;
-		memcpy(p, family, sizeof(family));
-
-		if (nlsock < 0)
-			nlsock = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
-		if (nlsock < 0) {
-			warn("socket 'AF_NETLINK':");
-			return 0;
-		}
-		if (send(nlsock, ctrl, sizeof(ctrl), 0) != sizeof(ctrl)) {
-			warn("send 'AF_NETLINK':");
-			return 0;
-		}
-		r = recv(nlsock, resp, sizeof(resp), 0);
-		if (r < 0) {
-			warn("recv 'AF_NETLINK':");
-			return 0;
+		if (!(s = getstation(interface)) || !s->ssid[0]) {
+			putstations();
+			return NULL;
 		}
-		if ((size_t)r <= sizeof(ctrl))
-			return 0;
-		p = findattr(CTRL_ATTR_FAMILY_ID, resp + sizeof(ctrl), resp + r, &len);
-		if (p && len == 2)
-			memcpy(&id, p, 2);
+		memcpy(ssid, s->ssid, sizeof(ssid));
+		putstations();
 
-		return id;
+		return bprintf("%s", ssid);
 	}
 
-	static int
-	ifindex(const char *interface)
+	const char *
+	wifi_perc(const char *interface)
 	{
-		static struct ifreq ifr;
-		static int ifsock = -1;
-
-		if (ifsock < 0)
-			ifsock = socket(AF_UNIX, SOCK_DGRAM, 0);
-		if (ifsock < 0) {
-			warn("socket 'AF_UNIX':");
-			return -1;
+		const struct station *s;
+		static int show = 0;
+		int dBm;
+
+		if (!(s = getstation(interface))) {
+			putstations();
+			return NULL;
 		}
-		if (strcmp(ifr.ifr_name, interface) != 0) {
-			strcpy(ifr.ifr_name, interface);
-			if (ioctl(ifsock, SIOCGIFINDEX, &ifr) != 0) {
-				warn("ioctl 'SIOCGIFINDEX':");
-				return -1;
-			}
+		dBm = s->signal;
+		putstations();
+
+		if (!dBm) {
+			show = !show;
+			return bprintf("│  %s  ", show ? "󱚵" : " ");
+		} else if (dBm >= -67) {
+			return bprintf("");
+		} else if (dBm >= -70) {
+			return bprintf("│ 󰖩 %ddBm ", dBm);
+		} else {
+			show = !show;
+			if (show)
+				return bprintf("│ 󰖩 %ddBm ", dBm);
+			else
+				return bprintf("│ 󰖩        ");
 		}
-		return ifr.ifr_ifindex;
 	}
 
 	const char *
-	wifi_essid(const char *interface)
+	wifi_bitrate(const char *interface)
 	{
-		uint16_t fam = nl80211fam();
-		ssize_t r;
-		size_t len;
-		char req[NLMSG_HDRLEN+GENL_HDRLEN+NLA_HDRLEN+NLA_ALIGN(4)] = {0}, *p = req;
-		int idx = ifindex(interface);
-		if (!fam) {
-			fprintf(stderr, "nl80211 family not found\n");
-			return NULL;
-		}
-		if (idx < 0) {
-			fprintf(stderr, "interface %s not found\n", interface);
-			return NULL;
-		}
+		const struct station *s;
+		unsigned int rx, tx;
 
-		memcpy(p, &(struct nlmsghdr){
-			.nlmsg_len = sizeof(req),
-			.nlmsg_type = fam,
-			.nlmsg_flags = NLM_F_REQUEST,
-			.nlmsg_seq = seq++,
-			.nlmsg_pid = 0,
-		}, sizeof(struct nlmsghdr));
-		p += NLMSG_HDRLEN;
-		memcpy(p, &(struct genlmsghdr){
-			.cmd = NL80211_CMD_GET_INTERFACE,
-			.version = 1,
-		}, sizeof(struct genlmsghdr));
-		p += GENL_HDRLEN;
-		memcpy(p, &(struct nlattr){
-			.nla_len = NLA_HDRLEN+4,
-			.nla_type = NL80211_ATTR_IFINDEX,
-		}, sizeof(struct nlattr));
-		p += NLA_HDRLEN;
-		memcpy(p, &(uint32_t){idx}, 4);
-
-		if (send(nlsock, req, sizeof(req), 0) != sizeof(req)) {
-			warn("send 'AF_NETLINK':");
-			return NULL;
-		}
-		r = recv(nlsock, resp, sizeof(resp), 0);
-		if (r < 0) {
-			warn("recv 'AF_NETLINK':");
+		if (!(s = getstation(interface)) || !s->signal) {
+			putstations();
 			return NULL;
 		}
+		rx = s->rxrate;
+		tx = s->txrate;
+		putstations();
 
-		if ((size_t)r <= NLMSG_HDRLEN + GENL_HDRLEN)
-			return NULL;
-		p = findattr(NL80211_ATTR_SSID, resp + NLMSG_HDRLEN + GENL_HDRLEN, resp + r, &len);
-		if (p)
-			p[len] = 0;
-
-		return p;
+		return bprintf("%u/%u", rx / 10, tx / 10);
 	}
 
 	const char *
-	wifi_perc(const char *interface)
+	wifi_throughput(const char *interface)
 	{
-		int dBm = 0;
-		static int show = 0;
-		struct nlmsghdr hdr;
-		uint16_t fam = nl80211fam();
-		ssize_t r;
-		size_t len;
-		char req[NLMSG_HDRLEN + GENL_HDRLEN + NLA_HDRLEN + NLA_ALIGN(4)] = {0}, *p = req, *e;
-		int idx = ifindex(interface);
+		const struct station *s;
+		unsigned int kbps;
 
-		if (idx < 0) {
-			fprintf(stderr, "interface %s not found\n", interface);
+		if (!(s = getstation(interface)) || !s->expected) {
+			putstations();
 			return NULL;
 		}
+		kbps = s->expected;
+		putstations();
 
-		memcpy(p, &(struct nlmsghdr){
-			.nlmsg_len = sizeof(req),
-			.nlmsg_type = fam,
-			.nlmsg_flags = NLM_F_REQUEST|NLM_F_DUMP,
-			.nlmsg_seq = seq++,
-			.nlmsg_pid = 0,
-		}, sizeof(struct nlmsghdr));
-		p += NLMSG_HDRLEN;
-		memcpy(p, &(struct genlmsghdr){
-			.cmd = NL80211_CMD_GET_STATION,
-			.version = 1,
-		}, sizeof(struct genlmsghdr));
-		p += GENL_HDRLEN;
-		memcpy(p, &(struct nlattr){
-			.nla_len = NLA_HDRLEN + 4,
-			.nla_type = NL80211_ATTR_IFINDEX,
-		}, sizeof(struct nlattr));
-		p += NLA_HDRLEN;
-		memcpy(p, &idx, 4);
-
-		if (send(nlsock, req, sizeof(req), 0) != sizeof(req)) {
-			warn("send 'AF_NETLINK':");
-			return NULL;
-		}
-
-		while (1) {
-			r = recv(nlsock, resp, sizeof(resp), 0);
-			if (r < 0) {
-				warn("recv 'AF_NETLINK':");
-				return NULL;
-			}
-			if ((size_t)r < sizeof(hdr))
-				return NULL;
-
-			for (p = resp; p != resp + r && (size_t)(resp + r-p) >= sizeof(hdr); p = e) {
-				memcpy(&hdr, p, sizeof(hdr));
-				e = resp + r - p < hdr.nlmsg_len ? resp + r : p + hdr.nlmsg_len;
-
-				if (!dBm && hdr.nlmsg_len > NLMSG_HDRLEN+GENL_HDRLEN) {
-					p += NLMSG_HDRLEN+GENL_HDRLEN;
-					p = findattr(NL80211_ATTR_STA_INFO, p, e, &len);
-					if (p)
-						p = findattr(NL80211_STA_INFO_SIGNAL_AVG, p, e, &len);
-					if (p && len == 1) {
-						dBm = *p;
-					}
-				}
-				if (hdr.nlmsg_type == NLMSG_DONE) {
-					if (!dBm) {
-						show = !show;
-						return bprintf("│  %s  ", show ? "󱚵" : " ");
-					} else if (dBm >= -67) {
-						return bprintf("");
-					} else if (dBm >= -70) {
-						return bprintf("│ 󰖩 %ddBm ", dBm);
-					} else {
-						show = !show;
-						if (show)
-							return bprintf("│ 󰖩 %ddBm ", dBm);
-						else
-							return bprintf("│ 󰖩        ");
-					}
-				}
-			}
-		}
+		return bprintf("%u", kbps / 1000);
 	}
 #elif defined(__OpenBSD__)
 	#include <net/if.h>
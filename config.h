@@ -1,14 +1,30 @@
 /* See LICENSE file for copyright and license details. */
 
-/* interval between updates (in ms) */
+/* interval between updates (in ms), unless an argument sets its own */
 const unsigned int interval = 1000;
 
+/* run_command_async: timeout and minimum time between runs (in ms) */
+const unsigned int run_timeout = 5000;
+const unsigned int run_period = 1000;
+
+/* cpu_freq_*: cpus read per update, in turn, 0 for all of them */
+const unsigned int freq_sample = 64;
+
 /* text to show if no value can be retrieved */
 static const char unknown_str[] = "n/a";
 
 /* maximum output string length */
 #define MAXLEN 2048
 
+/* threads running the arguments with a deadline */
+#define WORKERS 2
+
+/* text appended to values which missed their deadline */
+static const char stale_str[] = "*";
+
+/* read the files of each update in one batch through io_uring, if available */
+#define URING 1
+
 /*
  * function            description                     argument (example)
  *
@@ -18,8 +34,15 @@ static const char unknown_str[] = "n/a";
  *                                                     NULL on OpenBSD
  * battery_remaining   battery remaining HH:MM         battery name (BAT0)
  *                                                     NULL on OpenBSD
+ * coprocess           last line of a running command  command (tail -F log)
  * cpu_perc            cpu usage in percent            NULL
+ * cpu_perc_cores_bar  usage of every core as a bar    NULL (Linux)
+ * cpu_perc_cores_max  usage of the busiest core       NULL (Linux)
+ * cpu_perc_cores_top  the busiest cores as cpu:perc   number of cores (3)
+ *                                                     (Linux)
  * cpu_freq            cpu frequency in MHz            NULL
+ * cpu_freq_all        frequency of all cpus           min, avg or max (Linux)
+ * cpu_freq_clusters   cpu_freq_all per cluster        min, avg or max (Linux)
  * datetime            date and time                   format string (%F %T)
  * disk_free           free disk space in GB           mountpoint path (/)
  * disk_perc           disk usage in percent           mountpoint path (/)
@@ -38,6 +61,14 @@ static const char unknown_str[] = "n/a";
  * load_avg            load average                    NULL
  * netspeed_rx         receive network speed           interface name (wlan0)
  * netspeed_tx         transfer network speed          interface name (wlan0)
+ * netpackets_rx       received packets per second     interface name (wlan0)
+ *                                                     (Linux)
+ * netpackets_tx       sent packets per second         interface name (wlan0)
+ *                                                     (Linux)
+ * net_errors          receive/transmit errors         interface name (wlan0)
+ *                                                     (Linux)
+ * net_drops           receive/transmit drops          interface name (wlan0)
+ *                                                     (Linux)
  * num_files           number of files in a directory  path
  *                                                     (/home/foo/Inbox/cur)
  * ram_free            free memory in GB               NULL
@@ -45,6 +76,7 @@ static const char unknown_str[] = "n/a";
  * ram_total           total memory size in GB         NULL
  * ram_used            used memory in GB               NULL
  * run_command         custom shell command            command (echo foo)
+ * run_command_async   run_command in the background   command (echo foo)
  * swap_free           free swap in GB                 NULL
  * swap_perc           swap usage in percent           NULL
  * swap_total          total swap size in GB           NULL
@@ -68,6 +100,13 @@ static const char unknown_str[] = "n/a";
  * vpn_state           VPN active                      interface name (vpn0)
  * file_message        first 128 characters up to \n   path
  * tmp_perc_gt         /tmp /run percentage used       minimum percentage
+ *
+ * The optional interval (in ms) refreshes an argument on its own schedule,
+ * its last value is shown in between. 0 uses the global interval.
+ *
+ * The optional deadline (in ms) runs an argument in a worker thread, a tick
+ * waits for it at most that long and shows its last value as stale if it is
+ * late. Such functions must be thread-safe across all threaded arguments.
  */
 static const struct arg args[] = {
 
@@ -98,7 +137,7 @@ static const struct arg args[] = {
 	{ lm_sensors,			"%s",		"" },
 #endif
 
-	{ tmp_perc_gt,			"%s",		"50" },
+	{ tmp_perc_gt,			"%s",		"50",		10000 },
 
 	{ ram_perc,				"│ %s%%",	0 },
 	{ swap_perc,			" %s%% ",	0 },
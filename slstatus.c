@@ -1,58 +1,473 @@
 /* See LICENSE file for copyright and license details. */
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <X11/Xlib.h>
 
 #include "arg.h"
 #include "slstatus.h"
+#include "source.h"
 #include "util.h"
 
 struct arg {
 	const char *(*func)(const char *);
 	const char *fmt;
 	const char *args;
+	unsigned int interval; /* in ms, 0 for the global interval */
+	unsigned int deadline; /* in ms, 0 to run in the main thread */
 };
 
-char buf[1024];
-static volatile sig_atomic_t done;
+/* buckets of the latency histograms, by powers of two in ns */
+enum { NBUCKETS = 40 };
+
+struct prof {
+	unsigned long calls, nulls;
+	uint64_t min, max, sum; /* in ns */
+	unsigned long hist[NBUCKETS];
+};
+
+struct watch {
+	int fd;
+	int (*cb)(int fd, void *data);
+	void *data;
+};
+
+/* epoll tags of the loop's own fds, after those of the watches */
+enum { MAXWATCH = 32, TIMERFD = MAXWATCH, SIGNALFD, XFD, WORKFD };
+
+/* state of an argument run by the workers */
+enum { IDLE, QUEUED, RUNNING, READY };
+
+__thread char buf[1024];
+static __thread int worker;
+static int done, refresh, pflag;
 static Display *dpy;
+static int epfd = -1, tfd = -1, sfd = -1, wfd = -1;
+static struct watch watches[MAXWATCH];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished;
 
 #include "config.h"
 
+/* last value and segment, next due time (in ms) and watches of every argument */
+static char vals[LEN(args)][MAXLEN];
+static char segs[LEN(args)][MAXLEN];
+static int valid[LEN(args)];
+static uintmax_t due[LEN(args)];
+static uint32_t deps[LEN(args)];
+static size_t cur = LEN(args);
+
+/* worker state, deadline (in ms) and result of every argument */
+static int state[LEN(args)];
+static int stale[LEN(args)];
+static uintmax_t deadlines[LEN(args)];
+static char results[LEN(args)][MAXLEN];
+
+/* latencies of every argument, recorded with -p */
+static struct prof profs[LEN(args)];
+
+/* status updates written and skipped for being unchanged */
+static unsigned long emitted, suppressed;
+
+int
+watch(int fd, int (*cb)(int fd, void *data), void *data)
+{
+	struct epoll_event ev;
+	size_t i, w;
+
+	/* the watches belong to the main thread */
+	if (epfd < 0 || worker)
+		return -1;
+
+	for (w = 0; w < MAXWATCH && !(watches[w].cb && watches[w].fd == fd);
+	     w++)
+		;
+	if (w == MAXWATCH) {
+		for (w = 0; w < MAXWATCH && watches[w].cb; w++)
+			;
+		if (w == MAXWATCH) {
+			warn("watch: Too many watches");
+			return -1;
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.u32 = w;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			warn("epoll_ctl '%d':", fd);
+			return -1;
+		}
+		for (i = 0; i < LEN(args); i++)
+			deps[i] &= ~(UINT32_C(1) << w);
+		watches[w].fd = fd;
+		watches[w].cb = cb;
+		watches[w].data = data;
+	}
+
+	/* the argument being evaluated depends on this watch */
+	if (cur < LEN(args))
+		deps[cur] |= UINT32_C(1) << w;
+	else
+		for (i = 0; i < LEN(args); i++)
+			deps[i] |= UINT32_C(1) << w;
+
+	return 0;
+}
+
+void
+unwatch(int fd)
+{
+	size_t w;
+
+	/* the dependencies are kept until the slot is reused */
+	for (w = 0; w < MAXWATCH; w++) {
+		if (!watches[w].cb || watches[w].fd != fd)
+			continue;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) < 0)
+			warn("epoll_ctl '%d':", fd);
+		watches[w].cb = NULL;
+	}
+}
+
+static int
+addfd(int fd, uint32_t tag)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;
+	ev.data.u32 = tag;
+
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
 static void
-terminate(const int signo)
+schedule(size_t i, uintmax_t now)
 {
-	if (signo != SIGUSR1)
-		done = 1;
+	unsigned int iv;
+
+	/* keep a steady cadence unless we fell behind */
+	iv = args[i].interval ? args[i].interval : interval;
+	due[i] = (due[i] && due[i] + iv > now) ? due[i] + iv : now + iv;
+}
+
+static int
+store(size_t i, const char *res, int old)
+{
+	char val[MAXLEN];
+
+	/* only format the segment again when the value changed */
+	if (valid[i] && stale[i] == old && !strcmp(vals[i], res))
+		return 0;
+
+	if (res != vals[i] &&
+	    esnprintf(vals[i], sizeof(vals[i]), "%s", res) < 0)
+		goto err;
+	if (esnprintf(val, sizeof(val), "%s%s", vals[i],
+	              old ? stale_str : "") < 0 ||
+	    esnprintf(segs[i], sizeof(segs[i]), args[i].fmt, val) < 0)
+		goto err;
+	valid[i] = 1;
+	stale[i] = old;
+
+	return 1;
+err:
+	vals[i][0] = segs[i][0] = '\0';
+	valid[i] = 0;
+
+	return 1;
+}
+
+static uint64_t
+nanotime(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		die("clock_gettime:");
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+record(size_t i, uint64_t ns, int null)
+{
+	struct prof *p = &profs[i];
+	int b;
+
+	b = ns ? 63 - __builtin_clzll(ns) : 0;
+	p->hist[MIN(b, NBUCKETS - 1)]++;
+	if (!p->calls || ns < p->min)
+		p->min = ns;
+	if (ns > p->max)
+		p->max = ns;
+	p->sum += ns;
+	p->nulls += null;
+	p->calls++;
+}
+
+/* upper bound of the bucket holding the given quantile, in ns */
+static uint64_t
+quantile(const struct prof *p, unsigned long perc)
+{
+	unsigned long n, rank;
+	int b;
+
+	rank = (p->calls * perc + 99) / 100;
+	for (b = 0, n = 0; b < NBUCKETS - 1; b++)
+		if ((n += p->hist[b]) >= rank)
+			break;
+
+	return MIN(UINT64_C(2) << b, p->max);
+}
+
+static void
+profile(void)
+{
+	const struct prof *p;
+	size_t i;
+
+	pthread_mutex_lock(&lock);
+	fprintf(stderr, "%-3s %-24s %8s %6s %9s %9s %9s %9s %9s\n", "arg",
+	        "argument", "calls", "nulls", "min/us", "mean/us", "p50/us",
+	        "p99/us", "max/us");
+	for (i = 0; i < LEN(args); i++) {
+		p = &profs[i];
+		fprintf(stderr, "%-3zu %-24.24s %8lu %6lu %9.1f %9.1f %9.1f "
+		        "%9.1f %9.1f\n", i, args[i].args ? args[i].args : "",
+		        p->calls, p->nulls, p->min / 1E3,
+		        p->calls ? p->sum / 1E3 / p->calls : 0.0,
+		        p->calls ? quantile(p, 50) / 1E3 : 0.0,
+		        p->calls ? quantile(p, 99) / 1E3 : 0.0, p->max / 1E3);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static int
+update(size_t i)
+{
+	const char *res;
+	uint64_t start;
+
+	start = pflag ? nanotime() : 0;
+	cur = i;
+	reader = i + 1;
+	res = args[i].func(args[i].args);
+	reader = 0;
+	cur = LEN(args);
+	if (pflag)
+		record(i, nanotime() - start, !res);
+
+	return store(i, res ? res : unknown_str, 0);
+}
+
+static void *
+run(void *unused)
+{
+	const char *res;
+	uint64_t one = 1, start, ns;
+	size_t i;
+
+	worker = 1;
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		for (;;) {
+			for (i = 0; i < LEN(args) && state[i] != QUEUED; i++)
+				;
+			if (i < LEN(args))
+				break;
+			pthread_cond_wait(&work, &lock);
+		}
+		state[i] = RUNNING;
+		pthread_mutex_unlock(&lock);
+
+		start = pflag ? nanotime() : 0;
+		reader = i + 1;
+		res = args[i].func(args[i].args);
+		reader = 0;
+		ns = pflag ? nanotime() - start : 0;
+		if (esnprintf(results[i], sizeof(results[i]), "%s",
+		              res ? res : unknown_str) < 0)
+			results[i][0] = '\0';
+
+		pthread_mutex_lock(&lock);
+		if (pflag)
+			record(i, ns, !res);
+		state[i] = READY;
+		pthread_cond_signal(&finished);
+		pthread_mutex_unlock(&lock);
+
+		/* wake the main loop for results past their deadline */
+		if (write(wfd, &one, sizeof(one)) < 0)
+			warn("write 'eventfd':");
+	}
+
+	return NULL;
+}
+
+static void
+submit(size_t i, uintmax_t now)
+{
+	static int started;
+	pthread_condattr_t attr;
+	pthread_t thread;
+	int n;
+
+	if (!started) {
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&finished, &attr);
+		pthread_condattr_destroy(&attr);
+
+		if ((wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+		    addfd(wfd, WORKFD) < 0)
+			die("eventfd:");
+		for (n = 0; n < WORKERS; n++)
+			if ((errno = pthread_create(&thread, NULL, run, NULL)) ||
+			    (errno = pthread_detach(thread)))
+				die("pthread_create:");
+		started = 1;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (state[i] == IDLE) {
+		state[i] = QUEUED;
+		deadlines[i] = now + args[i].deadline;
+		pthread_cond_signal(&work);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/* n counts the results which came in */
+static int
+gather(size_t *n)
+{
+	struct timespec ts;
+	uintmax_t now, wake;
+	size_t i;
+	int changed;
+
+	if (wfd < 0)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+
+	/* wait for the results due before their deadline */
+	for (;;) {
+		now = monotonic();
+		for (i = 0, wake = UINTMAX_MAX; i < LEN(args); i++)
+			if ((state[i] == QUEUED || state[i] == RUNNING) &&
+			    deadlines[i] > now && deadlines[i] < wake)
+				wake = deadlines[i];
+		if (wake == UINTMAX_MAX)
+			break;
+
+		ts.tv_sec = wake / 1000;
+		ts.tv_nsec = (wake % 1000) * 1E6;
+		pthread_cond_timedwait(&finished, &lock, &ts);
+	}
+
+	/* late arguments keep their last value, marked as stale */
+	for (i = changed = 0; i < LEN(args); i++) {
+		if (state[i] == READY) {
+			changed |= store(i, results[i], 0);
+			state[i] = IDLE;
+			(*n)++;
+		} else if (state[i] != IDLE && !stale[i]) {
+			changed |= store(i, valid[i] ? vals[i] : unknown_str, 1);
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	return changed;
 }
 
 static void
-difftimespec(struct timespec *res, struct timespec *a, struct timespec *b)
+stats(void)
 {
-	res->tv_sec = a->tv_sec - b->tv_sec - (a->tv_nsec < b->tv_nsec);
-	res->tv_nsec = a->tv_nsec - b->tv_nsec +
-	               (a->tv_nsec < b->tv_nsec) * 1E9;
+	fprintf(stderr, "slstatus: %lu updates emitted, %lu suppressed\n",
+	        emitted, suppressed);
+	if (pflag)
+		profile();
+}
+
+static void
+dispatch(struct epoll_event *ev)
+{
+	struct signalfd_siginfo si;
+	uint64_t count;
+	XEvent xev;
+	size_t i;
+	uint32_t w;
+
+	switch ((w = ev->data.u32)) {
+	case TIMERFD:
+		if (read(tfd, &count, sizeof(count)) < 0 &&
+		    errno != EAGAIN)
+			die("read 'timerfd':");
+		break;
+	case SIGNALFD:
+		while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+			if (si.ssi_signo == SIGUSR1)
+				refresh = 1;
+			else if (si.ssi_signo == SIGUSR2)
+				stats();
+			else
+				done = 1;
+		}
+		break;
+	case XFD:
+		while (XPending(dpy))
+			XNextEvent(dpy, &xev);
+		break;
+	case WORKFD:
+		/* the results are gathered on every iteration */
+		if (read(wfd, &count, sizeof(count)) < 0 &&
+		    errno != EAGAIN)
+			die("read 'eventfd':");
+		break;
+	default:
+		if (w >= MAXWATCH || !watches[w].cb)
+			break;
+
+		/* refresh the dependent arguments right away */
+		if (watches[w].cb(watches[w].fd, watches[w].data))
+			for (i = 0; i < LEN(args); i++)
+				if (deps[i] & (UINT32_C(1) << w))
+					due[i] = 0;
+		break;
+	}
 }
 
 static void
 usage(void)
 {
-	die("usage: %s [-v] [-s] [-1]", argv0);
+	die("usage: %s [-v] [-s] [-1] [-p]", argv0);
 }
 
 int
 main(int argc, char *argv[])
 {
-	struct sigaction act;
-	struct timespec start, current, diff, intspec, wait;
-	size_t i, len;
-	int sflag, ret;
-	char status[MAXLEN];
-	const char *res;
+	struct epoll_event evs[MAXWATCH];
+	struct itimerspec its;
+	sigset_t mask;
+	uintmax_t now, next;
+	uint64_t ahead;
+	size_t i, len, evaluated;
+	int sflag, ret, n, changed, force;
+	char status[MAXLEN], last[MAXLEN];
 
 	sflag = 0;
 	ARGBEGIN {
@@ -65,6 +480,9 @@ main(int argc, char *argv[])
 	case 's':
 		sflag = 1;
 		break;
+	case 'p':
+		pflag = 1;
+		break;
 	default:
 		usage();
 	} ARGEND
@@ -72,33 +490,83 @@ main(int argc, char *argv[])
 	if (argc)
 		usage();
 
-	memset(&act, 0, sizeof(act));
-	act.sa_handler = terminate;
-	sigaction(SIGINT,  &act, NULL);
-	sigaction(SIGTERM, &act, NULL);
-	act.sa_flags |= SA_RESTART;
-	sigaction(SIGUSR1, &act, NULL);
+	/* signals are only received through the signalfd */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		die("sigprocmask:");
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("epoll_create1:");
+	if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+	    addfd(sfd, SIGNALFD) < 0)
+		die("signalfd:");
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC,
+	                          TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+	    addfd(tfd, TIMERFD) < 0)
+		die("timerfd_create:");
 
 	if (!sflag && !(dpy = XOpenDisplay(NULL)))
 		die("XOpenDisplay: Failed to open display");
+	if (dpy && addfd(ConnectionNumber(dpy), XFD) < 0)
+		die("epoll_ctl 'XConnectionNumber':");
+
+	/* without io_uring every file is read on its own */
+	if (URING)
+		prefetchinit();
 
 	do {
-		if (clock_gettime(CLOCK_MONOTONIC, &start) < 0)
-			die("clock_gettime:");
+		/* shared sources are read again once per iteration */
+		nexttick();
+		now = monotonic();
 
-		status[0] = '\0';
-		for (i = len = 0; i < LEN(args); i++) {
-			if (!(res = args[i].func(args[i].args)))
-				res = unknown_str;
+		/* read the files of the due arguments ahead in one batch */
+		for (i = 0, ahead = 0; i < LEN(args) && i < 64; i++)
+			if (refresh || due[i] <= now)
+				ahead |= UINT64_C(1) << i;
+		prefetch(ahead);
 
-			if ((ret = esnprintf(status + len, sizeof(status) - len,
-			                     args[i].fmt, res)) < 0)
-				break;
+		/* only evaluate the arguments which are due */
+		for (i = changed = evaluated = 0; i < LEN(args); i++) {
+			if (!refresh && due[i] > now)
+				continue;
 
-			len += ret;
+			schedule(i, now);
+			if (args[i].deadline) {
+				submit(i, now);
+			} else {
+				changed |= update(i);
+				evaluated++;
+			}
 		}
+		changed |= gather(&evaluated);
 
-		if (sflag) {
+		/* a forced refresh rewrites the status even if unchanged */
+		force = refresh || !emitted;
+		refresh = 0;
+
+		if (changed || force) {
+			status[0] = '\0';
+			for (i = len = 0; i < LEN(args); i++) {
+				if ((ret = esnprintf(status + len,
+				                     sizeof(status) - len,
+				                     "%s", segs[i])) < 0)
+					break;
+
+				len += ret;
+			}
+			changed = force || strcmp(status, last);
+		}
+
+		/* write the status only when it differs from the last one */
+		if (!changed) {
+			/* wakeups without a new result are not counted */
+			if (evaluated)
+				suppressed++;
+		} else if (sflag) {
 			puts(status);
 			fflush(stdout);
 			if (ferror(stdout))
@@ -108,26 +576,38 @@ main(int argc, char *argv[])
 				die("XStoreName: Allocation failed");
 			XFlush(dpy);
 		}
+		if (changed) {
+			memcpy(last, status, sizeof(last));
+			emitted++;
+		}
 
 		if (DBG)
 			exit(0);
 
-		if (!done) {
-			if (clock_gettime(CLOCK_MONOTONIC, &current) < 0)
-				die("clock_gettime:");
-			difftimespec(&diff, &current, &start);
+		if (done)
+			break;
 
-			intspec.tv_sec = interval / 1000;
-			intspec.tv_nsec = (interval % 1000) * 1E6;
-			difftimespec(&wait, &intspec, &diff);
+		/* wake when the next argument is due or an fd is ready */
+		for (i = 0, next = UINTMAX_MAX; i < LEN(args); i++)
+			if (due[i] < next)
+				next = due[i];
 
-			if (wait.tv_sec >= 0 &&
-			    nanosleep(&wait, NULL) < 0 &&
-			    errno != EINTR)
-					die("nanosleep:");
-		}
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = next / 1000;
+		its.it_value.tv_nsec = (next % 1000) * 1E6;
+		if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+			die("timerfd_settime:");
+
+		if ((n = epoll_wait(epfd, evs, LEN(evs), -1)) < 0 &&
+		    errno != EINTR)
+			die("epoll_wait:");
+		for (i = 0; n > 0 && i < (size_t)n; i++)
+			dispatch(&evs[i]);
 	} while (!done);
 
+	if (pflag)
+		stats();
+
 	if (!sflag) {
 		XStoreName(dpy, DefaultRootWindow(dpy), NULL);
 		if (XCloseDisplay(dpy) < 0)
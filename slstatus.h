@@ -2,6 +2,10 @@
 
 #define DBG 0
 
+/* event loop */
+int watch(int fd, int (*cb)(int fd, void *data), void *data);
+void unwatch(int fd);
+
 /* battery */
 const char *battery_perc(const char *);
 const char *battery_remaining(const char *);
@@ -11,9 +15,17 @@ const char *battery_summary(const char *);
 /* cat */
 const char *cat(const char *path);
 
+/* coprocess */
+const char *coprocess(const char *cmd);
+
 /* cpu */
 const char *cpu_freq(const char *unused);
+const char *cpu_freq_all(const char *stat);
+const char *cpu_freq_clusters(const char *stat);
 const char *cpu_perc(const char *unused);
+const char *cpu_perc_cores_bar(const char *unused);
+const char *cpu_perc_cores_max(const char *unused);
+const char *cpu_perc_cores_top(const char *num);
 
 /* datetime */
 const char *datetime(const char *fmt);
@@ -51,6 +63,10 @@ const char *load_avg(const char *unused);
 /* netspeeds */
 const char *netspeed_rx(const char *interface);
 const char *netspeed_tx(const char *interface);
+const char *netpackets_rx(const char *interface);
+const char *netpackets_tx(const char *interface);
+const char *net_errors(const char *interface);
+const char *net_drops(const char *interface);
 
 /* num_files */
 const char *num_files(const char *path);
@@ -63,6 +79,7 @@ const char *ram_used(const char *unused);
 
 /* run_command */
 const char *run_command(const char *cmd);
+const char *run_command_async(const char *cmd);
 
 /* swap */
 const char *swap_free(const char *unused);
@@ -85,8 +102,10 @@ const char *username(const char *unused);
 const char *vol_perc(const char *card);
 
 /* wifi */
+const char *wifi_bitrate(const char *interface);
 const char *wifi_essid(const char *interface);
 const char *wifi_perc(const char *interface);
+const char *wifi_throughput(const char *interface);
 
 /* lm_sensors */
 const char *lm_sensors(const char *opts);
@@ -0,0 +1,1766 @@
+/* See LICENSE file for copyright and license details. */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <X11/XKBlib.h>
+#include <X11/Xlib.h>
+
+#include "slstatus.h"
+#include "source.h"
+#include "uring.h"
+#include "util.h"
+
+struct source {
+	pthread_mutex_t lock;
+	unsigned long gen; /* tick of the snapshot */
+	int err;
+};
+
+/* advanced by the main thread while workers may be reading it */
+static unsigned long tick = 1;
+
+static struct source memsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source statsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source coresrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source freqsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source linksrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source ifcsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source ifsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source wlsrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source linesrc = { PTHREAD_MUTEX_INITIALIZER };
+static struct source xkbsrc = { PTHREAD_MUTEX_INITIALIZER };
+
+unsigned long
+gettick(void)
+{
+	return __atomic_load_n(&tick, __ATOMIC_ACQUIRE);
+}
+
+void
+nexttick(void)
+{
+	__atomic_add_fetch(&tick, 1, __ATOMIC_RELEASE);
+}
+
+/* lock the source, returns 1 when its snapshot is from an earlier tick */
+static int
+stale(struct source *s)
+{
+	unsigned long t = gettick();
+
+	pthread_mutex_lock(&s->lock);
+	if (s->gen == t)
+		return 0;
+	s->gen = t;
+
+	return 1;
+}
+
+static int
+done(struct source *s)
+{
+	int err;
+
+	err = s->err;
+	pthread_mutex_unlock(&s->lock);
+
+	return err;
+}
+
+static int
+readmeminfo(struct meminfo *mi)
+{
+	const struct field f[] = {
+		FIELD("MemTotal:",     &mi->total,        1),
+		FIELD("MemFree:",      &mi->free,         1),
+		FIELD("Buffers:",      &mi->buffers,      1),
+		FIELD("Cached:",       &mi->cached,       1),
+		FIELD("Shmem:",        &mi->shmem,        1),
+		FIELD("SReclaimable:", &mi->sreclaimable, 1),
+		FIELD("SwapCached:",   &mi->swapcached,   1),
+		FIELD("SwapTotal:",    &mi->swaptotal,    1),
+		FIELD("SwapFree:",     &mi->swapfree,     1),
+	};
+	uint64_t found;
+
+	/* a kernel without one of the ram keys still has swap, or the reverse */
+	found = pfields("/proc/meminfo", f, LEN(f));
+	mi->ram = (found & 0x3f) == 0x3f;
+	mi->swap = (found >> 6) == 0x7;
+
+	return found ? 0 : -1;
+}
+
+int
+meminfo(struct meminfo *mi)
+{
+	static struct meminfo snap;
+
+	if (stale(&memsrc))
+		memsrc.err = readmeminfo(&snap);
+	memcpy(mi, &snap, sizeof(*mi));
+
+	return done(&memsrc);
+}
+
+int
+cpustat(struct cpustat *cs)
+{
+	static struct cpustat snap;
+	/* cpu user nice system idle iowait irq softirq steal */
+	uintmax_t v[8];
+	const struct field f[] = { FIELD("cpu ", v, LEN(v)) };
+
+	if (stale(&statsrc)) {
+		statsrc.err = (pfields("/proc/stat", f, 1) == 1) ? 0 : -1;
+		snap.user = v[0];
+		snap.nice = v[1];
+		snap.system = v[2];
+		snap.idle = v[3];
+		snap.iowait = v[4];
+		snap.irq = v[5];
+		snap.softirq = v[6];
+		snap.steal = v[7];
+	}
+	memcpy(cs, &snap, sizeof(*cs));
+
+	return done(&statsrc);
+}
+
+/* busy and total jiffies of every cpu, as arrays for the vector code */
+struct jiffies {
+	size_t n;
+	unsigned int id[MAXCPU];
+	uint64_t busy[MAXCPU], total[MAXCPU];
+};
+
+/* four cpus at a time, with the vector extensions of the compiler */
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+typedef int32_t v4i32 __attribute__((vector_size(16)));
+typedef float v4f __attribute__((vector_size(16)));
+
+static int
+readcores(struct jiffies *j)
+{
+	static char b[(1 << 17) + SCANPAD];
+	uintmax_t id, v[8];
+	ssize_t len;
+	size_t k;
+	const char *p, *q, *eol;
+
+	/* the cpuN lines follow the aggregate cpu line */
+	if ((len = pslurp("/proc/stat", b, sizeof(b) - SCANPAD - 1)) < 0) {
+		warn("read '/proc/stat':");
+		return -1;
+	}
+	b[len] = '\0';
+
+	j->n = 0;
+	for (p = b; p < b + len && j->n < MAXCPU; p = eol + 1) {
+		eol = scanline(p, b + len);
+		if (strncmp(p, "cpu", 3))
+			break;
+		if (!(q = scannum(p + 3, &id)))
+			continue;
+
+		/* user nice system idle iowait irq softirq steal */
+		memset(v, 0, sizeof(v));
+		for (k = 0; k < LEN(v) && q && q < eol; k++)
+			q = scannum(skipblank(q), &v[k]);
+
+		/* guest time is part of user already */
+		j->id[j->n] = id;
+		j->busy[j->n] = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+		j->total[j->n] = j->busy[j->n] + v[3] + v[4];
+		j->n++;
+	}
+
+	return j->n ? 0 : -1;
+}
+
+static void
+percent(const struct jiffies *a, const struct jiffies *b, unsigned char *perc)
+{
+	v4u64 x, y;
+	v4i32 busy, total, m;
+	v4f fb, ft;
+	size_t i, k;
+
+	/* the deltas of an update fit 32 bits */
+	for (i = 0; i < a->n; i += 4) {
+		memcpy(&x, &a->busy[i], sizeof(x));
+		memcpy(&y, &b->busy[i], sizeof(y));
+		busy = __builtin_convertvector(x - y, v4i32);
+		memcpy(&x, &a->total[i], sizeof(x));
+		memcpy(&y, &b->total[i], sizeof(y));
+		total = __builtin_convertvector(x - y, v4i32);
+
+		/* 0 <= busy <= total, counters may go backwards */
+		total &= total > 0;
+		busy &= busy > 0;
+		m = busy > total;
+		busy = (busy & ~m) | (total & m);
+		fb = __builtin_convertvector(busy, v4f);
+		ft = __builtin_convertvector(total - (total == 0), v4f);
+		busy = __builtin_convertvector(fb * 100 / ft + 0.5f, v4i32);
+
+		for (k = 0; k < 4; k++)
+			perc[i + k] = busy[k];
+	}
+}
+
+/*
+ * the percentages are valid until putcores(), which has to follow in any
+ * case. NULL before the second read or after cpus went on- or offline.
+ */
+const struct cpucores *
+getcores(void)
+{
+	static struct jiffies j[2];
+	static struct cpucores cores;
+	static int cur;
+
+	if (stale(&coresrc)) {
+		cur = !cur;
+		coresrc.err = readcores(&j[cur]);
+		if (!coresrc.err && (j[cur].n != j[!cur].n ||
+		    memcmp(j[cur].id, j[!cur].id, j[cur].n * sizeof(j[cur].id[0]))))
+			coresrc.err = -1;
+		if (!coresrc.err) {
+			percent(&j[cur], &j[!cur], cores.perc);
+			memcpy(cores.id, j[cur].id, j[cur].n * sizeof(cores.id[0]));
+			cores.n = j[cur].n;
+		}
+	}
+
+	return coresrc.err ? NULL : &cores;
+}
+
+void
+putcores(void)
+{
+	done(&coresrc);
+}
+
+#define CPU_DIR "/sys/devices/system/cpu"
+
+/*
+ * cpus with cpufreq. the scaling_cur_freq of up to a quarter of the file
+ * descriptor limit are kept open, those of further cpus are opened when
+ * they are sampled, so that many cpus do not use up the descriptors.
+ */
+static unsigned int freqid[MAXCPU];
+static int freqfd[MAXCPU];
+static size_t nfreqfd; /* how many are kept open */
+static int cpudir = -1;
+static char online[256]; /* the cpus online when they were found */
+
+static ssize_t
+readonline(char *b, size_t size)
+{
+	ssize_t n;
+
+	if ((n = pslurp(CPU_DIR "/online", b, size - 1)) < 0)
+		n = 0;
+	b[n] = '\0';
+
+	return n;
+}
+
+static int
+freqfile(size_t i)
+{
+	char name[64];
+
+	if (i < nfreqfd)
+		return freqfd[i];
+	if (esnprintf(name, sizeof(name), "cpu%u/cpufreq/scaling_cur_freq",
+	              freqid[i]) < 0)
+		return -1;
+
+	return openat(cpudir, name, O_RDONLY | O_CLOEXEC);
+}
+
+static int
+openfreqs(struct cpufreqs *f)
+{
+	DIR *d;
+	struct dirent *dp;
+	unsigned long id;
+	char path[PATH_MAX], p[PATH_MAX], name[64], *end;
+	const char *rp;
+	struct rlimit rl;
+	int fd;
+
+	for (; f->n; f->n--)
+		if (f->n <= nfreqfd)
+			close(freqfd[f->n - 1]);
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY)
+		nfreqfd = MAXCPU;
+	else
+		nfreqfd = MIN(rl.rlim_cur / 4, MAXCPU);
+	if (cpudir < 0 &&
+	    (!(rp = rootpath(CPU_DIR, p, sizeof(p))) ||
+	     (cpudir = open(rp, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)) {
+		warn("open '%s':", CPU_DIR);
+		return -1;
+	}
+	if ((fd = dup(cpudir)) < 0 || !(d = fdopendir(fd))) {
+		warn("opendir '%s':", CPU_DIR);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	rewinddir(d);
+	readonline(online, sizeof(online));
+
+	while (f->n < MAXCPU && (dp = readdir(d))) {
+		if (strncmp(dp->d_name, "cpu", 3) ||
+		    (id = strtoul(dp->d_name + 3, &end, 10), *end) ||
+		    end == dp->d_name + 3)
+			continue;
+
+		/* offline cpus and those without cpufreq are left out */
+		if (esnprintf(name, sizeof(name),
+		              "cpu%lu/cpufreq/scaling_cur_freq", id) < 0 ||
+		    (fd = openat(cpudir, name, O_RDONLY | O_CLOEXEC)) < 0)
+			continue;
+		if (f->n < nfreqfd)
+			freqfd[f->n] = fd;
+		else
+			close(fd);
+		freqid[f->n] = id;
+
+		/* P and E cores, or none */
+		if (esnprintf(path, sizeof(path), CPU_DIR
+		              "/cpu%lu/topology/cluster_id", id) < 0 ||
+		    pscanf(path, "%d", &f->cluster[f->n]) != 1)
+			f->cluster[f->n] = -1;
+		f->khz[f->n++] = 0;
+	}
+	closedir(d);
+
+	return f->n ? 0 : -1;
+}
+
+/*
+ * read freq_sample of the cpus per tick, in turn, or all of them if there
+ * are not more. others keep their last value. returns -1 if a cpu could
+ * not be read, as it went offline.
+ */
+static int
+readfreqs(struct cpufreqs *f)
+{
+	extern const unsigned int freq_sample;
+	static size_t next;
+	static char b[32][32 + SCANPAD];
+	char *bp[LEN(b)];
+	ssize_t res[LEN(b)];
+	size_t i, j, k, m, size[LEN(b)], idx[LEN(b)];
+	int fd[LEN(b)], err;
+	uintmax_t v;
+
+	err = 0;
+	m = (freq_sample && f->n > freq_sample) ? freq_sample : f->n;
+	for (i = 0; i < m; i += k) {
+		for (k = 0; k < LEN(b) && i + k < m; k++) {
+			idx[k] = (next + i + k) % f->n;
+			fd[k] = freqfile(idx[k]);
+			bp[k] = b[k];
+			size[k] = sizeof(b[k]) - SCANPAD - 1;
+		}
+
+		/* one syscall for the batch if there is io_uring */
+		if (uringread(k, fd, bp, size, res) < 0)
+			for (j = 0; j < k; j++)
+				if ((res[j] = pread(fd[j], bp[j], size[j], 0)) < 0)
+					res[j] = -errno;
+
+		for (j = 0; j < k; j++) {
+			if (idx[j] >= nfreqfd && fd[j] >= 0)
+				close(fd[j]);
+			if (res[j] < 0) {
+				f->khz[idx[j]] = 0;
+				err = -1;
+				continue;
+			}
+			b[j][res[j]] = '\0';
+			f->khz[idx[j]] = scannum(skipblank(b[j]), &v) ? v : 0;
+		}
+	}
+	next = (next + m) % f->n;
+
+	return err;
+}
+
+/*
+ * the frequencies are valid until putfreqs(), which has to follow. the
+ * cpus are found again after one could not be read or others came online.
+ */
+const struct cpufreqs *
+getfreqs(void)
+{
+	static struct cpufreqs freqs;
+	static int rescan = 1;
+	char b[sizeof(online)];
+
+	if (stale(&freqsrc)) {
+		readonline(b, sizeof(b));
+		if (rescan || strcmp(b, online)) {
+			rescan = 0;
+			freqsrc.err = openfreqs(&freqs);
+		}
+		if (freqs.n && readfreqs(&freqs) < 0)
+			rescan = 1;
+	}
+
+	return freqsrc.err ? NULL : &freqs;
+}
+
+void
+putfreqs(void)
+{
+	done(&freqsrc);
+}
+
+#if defined(__linux__)
+	#include <arpa/inet.h>
+	#include <linux/genetlink.h>
+	#include <linux/netlink.h>
+	#include <linux/nl80211.h>
+	#include <linux/rtnetlink.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+
+	/*
+	 * the links by ifindex, open addressing. the dump is ordered by
+	 * ifindex, with more links those created last are left out.
+	 */
+	#define MAXLINK 64
+
+	static struct link links[MAXLINK];
+	static unsigned long linkgen;
+
+	static struct link *
+	linkslot(struct link *tab, int index)
+	{
+		size_t i, h;
+
+		for (i = 0, h = index; i < MAXLINK; i++, h++)
+			if (!tab[h % MAXLINK].index ||
+			    tab[h % MAXLINK].index == index)
+				return &tab[h % MAXLINK];
+
+		return NULL;
+	}
+
+	/* the kernel may know more or fewer counters than our headers */
+	static void
+	putstats(int index, const char *name, const void *stats, size_t len,
+	         uintmax_t now)
+	{
+		static int warned;
+		struct link *l;
+
+		if (!(l = linkslot(links, index))) {
+			if (!warned++)
+				warn("getlink: More than %d links", MAXLINK);
+			return;
+		}
+		if (l->index != index) {
+			memset(l, 0, sizeof(*l));
+			l->index = index;
+		} else {
+			l->prev = l->cur;
+			l->tprev = l->tcur;
+		}
+		memset(&l->cur, 0, sizeof(l->cur));
+		memcpy(&l->cur, stats, MIN(len, sizeof(l->cur)));
+		l->tcur = now;
+		l->gen = linkgen;
+		if (name)
+			esnprintf(l->name, sizeof(l->name), "%s", name);
+	}
+
+	/* request a dump of type and hand every reply to fn */
+	static int
+	nldump(int fd, int type, void (*fn)(struct nlmsghdr *))
+	{
+		static uint32_t seq;
+		struct {
+			struct nlmsghdr nh;
+			struct rtgenmsg g;
+		} req;
+		struct sockaddr_nl sa;
+		struct nlmsghdr *nh;
+		uint32_t b[1 << 13], id;
+		ssize_t len;
+
+		memset(&req, 0, sizeof(req));
+		req.nh.nlmsg_len = sizeof(req);
+		req.nh.nlmsg_type = type;
+		req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+		req.nh.nlmsg_seq = id = __atomic_add_fetch(&seq, 1,
+		                                           __ATOMIC_RELAXED);
+		req.g.rtgen_family = AF_UNSPEC;
+		memset(&sa, 0, sizeof(sa));
+		sa.nl_family = AF_NETLINK;
+		if (sendto(fd, &req, sizeof(req), 0, (struct sockaddr *)&sa,
+		           sizeof(sa)) < 0) {
+			warn("sendto 'NETLINK_ROUTE':");
+			return -1;
+		}
+
+		for (;;) {
+			if ((len = recv(fd, b, sizeof(b), 0)) < 0) {
+				if (errno == EINTR)
+					continue;
+				warn("recv 'NETLINK_ROUTE':");
+				return -1;
+			}
+			for (nh = (struct nlmsghdr *)b; NLMSG_OK(nh, len);
+			     nh = NLMSG_NEXT(nh, len)) {
+				/* replies to an earlier, failed dump */
+				if (nh->nlmsg_seq != id)
+					continue;
+				if (nh->nlmsg_type == NLMSG_DONE)
+					return 0;
+				if (nh->nlmsg_type == NLMSG_ERROR)
+					return -1;
+				fn(nh);
+			}
+		}
+	}
+
+	static int
+	nlsocket(unsigned int groups)
+	{
+		const struct timeval tv = { 1, 0 };
+		struct sockaddr_nl sa;
+		int fd;
+
+		if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+		                 NETLINK_ROUTE)) < 0) {
+			warn("socket 'NETLINK_ROUTE':");
+			return -1;
+		}
+		memset(&sa, 0, sizeof(sa));
+		sa.nl_family = AF_NETLINK;
+		sa.nl_groups = groups;
+		if (groups && bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+			warn("bind 'NETLINK_ROUTE':");
+			close(fd);
+			return -1;
+		}
+		/* a dump which does not end is given up instead of hanging */
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+			warn("setsockopt 'SO_RCVTIMEO':");
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	static uintmax_t linknow;
+
+	static void
+	linkmsg(struct nlmsghdr *nh)
+	{
+		struct ifinfomsg *ifm;
+		struct rtattr *rta;
+		const char *name;
+		const void *stats;
+		size_t statslen;
+		int len;
+
+		if (nh->nlmsg_type != RTM_NEWLINK)
+			return;
+
+		ifm = NLMSG_DATA(nh);
+		name = NULL;
+		stats = NULL;
+		statslen = 0;
+		len = IFLA_PAYLOAD(nh);
+		for (rta = IFLA_RTA(ifm); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFLA_IFNAME) {
+				name = RTA_DATA(rta);
+			} else if (rta->rta_type == IFLA_STATS64) {
+				stats = RTA_DATA(rta);
+				statslen = RTA_PAYLOAD(rta);
+			}
+		}
+		if (stats)
+			putstats(ifm->ifi_index, name, stats, statslen, linknow);
+	}
+
+	/* one RTM_GETLINK dump for the IFLA_STATS64 of every link */
+	static int
+	dumplinks(void)
+	{
+		static int fd = -1;
+		struct link tab[MAXLINK], *l;
+		size_t i;
+
+		if (fd < 0 && (fd = nlsocket(0)) < 0)
+			return -1;
+
+		linknow = monotonic();
+		linkgen++;
+		if (nldump(fd, RTM_GETLINK, linkmsg) < 0)
+			return -1;
+
+		/* drop the links which are gone */
+		memset(tab, 0, sizeof(tab));
+		for (i = 0; i < MAXLINK; i++)
+			if (links[i].index && links[i].gen == linkgen &&
+			    (l = linkslot(tab, links[i].index)))
+				*l = links[i];
+		memcpy(links, tab, sizeof(links));
+
+		return 0;
+	}
+
+	/* the link is valid until putlinks(), which has to follow in any case */
+	const struct link *
+	getlink(const char *name)
+	{
+		size_t i;
+
+		if (stale(&linksrc))
+			linksrc.err = dumplinks();
+		if (linksrc.err)
+			return NULL;
+
+		for (i = 0; i < MAXLINK; i++)
+			if (links[i].index && !strcmp(links[i].name, name))
+				return &links[i];
+
+		return NULL;
+	}
+
+	void
+	putlinks(void)
+	{
+		done(&linksrc);
+	}
+
+	/*
+	 * links and addresses, from a dump of each and then kept current by
+	 * the notifications on a socket watched by the main loop. without the
+	 * main loop they are dumped again every tick.
+	 */
+	#define MAXIFLINK 256
+	#define MAXADDR 256
+
+	static struct iflink {
+		int index;
+		char name[IF_NAMESIZE];
+		unsigned int flags;
+		unsigned char oper;
+	} iflinks[MAXIFLINK];
+
+	static struct ifaddress {
+		int index, family;
+		char addr[INET6_ADDRSTRLEN + IF_NAMESIZE + 1];
+	} addrs[MAXADDR];
+
+	static int ifmfd = -1, ifdfd = -1, ifwatched;
+
+	static struct iflink *
+	findlink(int index)
+	{
+		size_t i;
+
+		for (i = 0; i < MAXIFLINK; i++)
+			if (iflinks[i].index == index)
+				return &iflinks[i];
+
+		return NULL;
+	}
+
+	static void
+	linkinfo(struct nlmsghdr *nh)
+	{
+		static int warned;
+		struct ifinfomsg *ifm;
+		struct iflink *l;
+		struct rtattr *rta;
+		size_t i;
+		int len;
+
+		ifm = NLMSG_DATA(nh);
+		if (nh->nlmsg_type == RTM_DELLINK) {
+			if ((l = findlink(ifm->ifi_index)))
+				l->index = 0;
+			for (i = 0; i < MAXADDR; i++)
+				if (addrs[i].index == ifm->ifi_index)
+					addrs[i].index = 0;
+			return;
+		}
+		if (!(l = findlink(ifm->ifi_index)) && !(l = findlink(0))) {
+			if (!warned++)
+				warn("linkstate: More than %d links", MAXIFLINK);
+			return;
+		}
+
+		l->index = ifm->ifi_index;
+		l->flags = ifm->ifi_flags;
+		len = IFLA_PAYLOAD(nh);
+		for (rta = IFLA_RTA(ifm); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFLA_IFNAME)
+				esnprintf(l->name, sizeof(l->name), "%s",
+				          (char *)RTA_DATA(rta));
+			else if (rta->rta_type == IFLA_OPERSTATE)
+				l->oper = *(unsigned char *)RTA_DATA(rta);
+		}
+	}
+
+	static void
+	addrinfo(struct nlmsghdr *nh)
+	{
+		static int warned;
+		struct ifaddrmsg *ifa;
+		struct iflink *l;
+		struct rtattr *rta;
+		struct ifaddress a, *free;
+		const void *addr, *local;
+		size_t i, n;
+		int len;
+
+		ifa = NLMSG_DATA(nh);
+		if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+			return;
+
+		/* the local end of point-to-point links, like getifaddrs */
+		addr = local = NULL;
+		len = IFA_PAYLOAD(nh);
+		for (rta = IFA_RTA(ifa); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFA_ADDRESS)
+				addr = RTA_DATA(rta);
+			else if (rta->rta_type == IFA_LOCAL)
+				local = RTA_DATA(rta);
+		}
+		if (local)
+			addr = local;
+		if (!addr)
+			return;
+
+		memset(&a, 0, sizeof(a));
+		a.index = ifa->ifa_index;
+		a.family = ifa->ifa_family;
+		if (!inet_ntop(a.family, addr, a.addr, INET6_ADDRSTRLEN))
+			return;
+		if (a.family == AF_INET6 && ifa->ifa_scope == RT_SCOPE_LINK &&
+		    (l = findlink(a.index))) {
+			n = strlen(a.addr);
+			esnprintf(a.addr + n, sizeof(a.addr) - n, "%%%s", l->name);
+		}
+
+		for (i = 0, free = NULL; i < MAXADDR; i++) {
+			if (!addrs[i].index) {
+				free = free ? free : &addrs[i];
+				continue;
+			}
+			if (addrs[i].index != a.index ||
+			    addrs[i].family != a.family ||
+			    strcmp(addrs[i].addr, a.addr))
+				continue;
+			if (nh->nlmsg_type == RTM_DELADDR)
+				addrs[i].index = 0;
+			return;
+		}
+		if (nh->nlmsg_type != RTM_NEWADDR)
+			return;
+		if (free)
+			*free = a;
+		else if (!warned++)
+			warn("linkaddr: More than %d addresses", MAXADDR);
+	}
+
+	static void
+	ifmsg(struct nlmsghdr *nh)
+	{
+		switch (nh->nlmsg_type) {
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			linkinfo(nh);
+			break;
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			addrinfo(nh);
+			break;
+		}
+	}
+
+	static int
+	dumpifs(void)
+	{
+		memset(iflinks, 0, sizeof(iflinks));
+		memset(addrs, 0, sizeof(addrs));
+
+		if (nldump(ifdfd, RTM_GETLINK, ifmsg) < 0 ||
+		    nldump(ifdfd, RTM_GETADDR, ifmsg) < 0)
+			return -1;
+
+		return 0;
+	}
+
+	/* the watch of the notifications, from the main loop */
+	static int
+	readifs(int fd, void *unused)
+	{
+		struct nlmsghdr *nh;
+		uint32_t b[1 << 13];
+		ssize_t len;
+		int changed;
+
+		pthread_mutex_lock(&ifcsrc.lock);
+		for (changed = 0;; changed = 1) {
+			if ((len = recv(fd, b, sizeof(b), MSG_DONTWAIT)) < 0) {
+				if (errno == EINTR)
+					continue;
+				/* notifications were lost, start over */
+				if (errno == ENOBUFS) {
+					ifcsrc.err = dumpifs();
+					continue;
+				}
+				break;
+			}
+			for (nh = (struct nlmsghdr *)b; NLMSG_OK(nh, len);
+			     nh = NLMSG_NEXT(nh, len))
+				ifmsg(nh);
+		}
+		pthread_mutex_unlock(&ifcsrc.lock);
+
+		return changed;
+	}
+
+	/* lock the cache, which is usable if 0 is returned */
+	static int
+	ifcache(void)
+	{
+		static unsigned long wtick;
+		static unsigned int wreader;
+		unsigned long t = gettick();
+
+		pthread_mutex_lock(&ifcsrc.lock);
+		if (ifdfd < 0) {
+			/* subscribe before the dump to miss nothing */
+			ifmfd = nlsocket(RTMGRP_LINK | RTMGRP_IPV4_IFADDR |
+			                 RTMGRP_IPV6_IFADDR);
+			if ((ifdfd = nlsocket(0)) < 0) {
+				pthread_mutex_unlock(&ifcsrc.lock);
+				return -1;
+			}
+			ifcsrc.err = dumpifs();
+			ifcsrc.gen = t;
+		}
+
+		/*
+		 * also makes the argument being evaluated depend on it, once
+		 * per evaluation however many lookups it does
+		 */
+		if (ifmfd >= 0 && (wtick != t || wreader != reader)) {
+			wtick = t;
+			wreader = reader;
+			if (watch(ifmfd, readifs, NULL) == 0)
+				ifwatched = 1;
+		}
+		if (!ifwatched && ifcsrc.gen != t) {
+			ifcsrc.gen = t;
+			ifcsrc.err = dumpifs();
+		}
+
+		return ifcsrc.err;
+	}
+
+	/* flags and operational state (IF_OPER_*) of a link */
+	int
+	linkstate(const char *name, unsigned int *flags, unsigned char *oper)
+	{
+		size_t i;
+
+		if (ifcache() < 0) {
+			pthread_mutex_unlock(&ifcsrc.lock);
+			return -1;
+		}
+		for (i = 0; i < MAXIFLINK; i++) {
+			if (!iflinks[i].index || strcmp(iflinks[i].name, name))
+				continue;
+			*flags = iflinks[i].flags;
+			*oper = iflinks[i].oper;
+			pthread_mutex_unlock(&ifcsrc.lock);
+			return 0;
+		}
+		pthread_mutex_unlock(&ifcsrc.lock);
+
+		return -1;
+	}
+
+	/* the first address of family on a link, in numeric form */
+	int
+	linkaddr(const char *name, int family, char *dst, size_t size)
+	{
+		struct iflink *l;
+		size_t i;
+		int ret;
+
+		if (ifcache() < 0) {
+			pthread_mutex_unlock(&ifcsrc.lock);
+			return -1;
+		}
+		for (i = 0, ret = -1; i < MAXADDR && ret < 0; i++) {
+			if (!addrs[i].index || addrs[i].family != family ||
+			    !(l = findlink(addrs[i].index)) ||
+			    strcmp(l->name, name))
+				continue;
+			ret = esnprintf(dst, size, "%s", addrs[i].addr);
+		}
+		pthread_mutex_unlock(&ifcsrc.lock);
+
+		return (ret < 0) ? -1 : 0;
+	}
+
+	/*
+	 * the wireless links, each queried with GET_INTERFACE and GET_STATION
+	 * in one datagram on a generic netlink socket. while the mlme group of
+	 * nl80211 is watched, (dis)connects and roams requery a link at once,
+	 * so its ssid is only asked for then and a steady signal is polled
+	 * less often, from once a second up to every eight, whatever the
+	 * interval of the argument.
+	 */
+	#define MAXWLAN 8
+	#define MINBACKOFF 1000 /* ms */
+	#define MAXBACKOFF 8000
+
+	#define NLA_DATA(a) ((void *)((char *)(a) + NLA_HDRLEN))
+	#define NLA_LEN(a) ((size_t)(a)->nla_len - NLA_HDRLEN)
+
+	static struct wlan {
+		struct station st;
+		int known;               /* the ssid is current */
+		int stations;            /* replies to the station dump */
+		unsigned long gen;
+		uintmax_t next, backoff; /* in ms */
+	} wlans[MAXWLAN];
+
+	static int wlfd = -1, wlmfd = -1, wlwatched;
+	static uint16_t wlfam;
+	static uint32_t wlmlme, wlseq;
+	static char *wlbuf;
+	static size_t wlsize = 8192;
+
+	/* the attributes in p by type, later ones win */
+	static void
+	nlattrs(const void *p, size_t len, const struct nlattr **tb, int max)
+	{
+		const struct nlattr *a;
+
+		memset(tb, 0, (max + 1) * sizeof(*tb));
+		for (a = p; len >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN &&
+		     a->nla_len <= len; a = (const void *)((const char *)a +
+		     NLA_ALIGN(a->nla_len))) {
+			if ((a->nla_type & NLA_TYPE_MASK) <= max)
+				tb[a->nla_type & NLA_TYPE_MASK] = a;
+			len -= MIN((size_t)NLA_ALIGN(a->nla_len), len);
+		}
+	}
+
+	static uint32_t
+	nlu32(const struct nlattr *a)
+	{
+		uint32_t v;
+
+		if (!a || NLA_LEN(a) < sizeof(v))
+			return 0;
+		memcpy(&v, NLA_DATA(a), sizeof(v));
+
+		return v;
+	}
+
+	/* start a request at offset off of b */
+	static struct nlmsghdr *
+	genlreq(uint32_t *b, size_t *off, uint16_t type, uint8_t cmd,
+	        uint16_t flags)
+	{
+		struct nlmsghdr *nh;
+		struct genlmsghdr *g;
+
+		nh = (struct nlmsghdr *)((char *)b + *off);
+		memset(nh, 0, NLMSG_HDRLEN + GENL_HDRLEN);
+		nh->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+		nh->nlmsg_type = type;
+		nh->nlmsg_flags = NLM_F_REQUEST | flags;
+		nh->nlmsg_seq = ++wlseq;
+		g = NLMSG_DATA(nh);
+		g->cmd = cmd;
+		g->version = 1;
+		*off += nh->nlmsg_len;
+
+		return nh;
+	}
+
+	/* append an attribute to the last request */
+	static void
+	genlattr(struct nlmsghdr *nh, size_t *off, uint16_t type,
+	         const void *data, size_t len)
+	{
+		struct nlattr *a;
+
+		a = (struct nlattr *)((char *)nh + nh->nlmsg_len);
+		memset(a, 0, NLA_HDRLEN + NLA_ALIGN(len));
+		a->nla_len = NLA_HDRLEN + len;
+		a->nla_type = type;
+		memcpy(NLA_DATA(a), data, len);
+		nh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(len);
+		*off += NLA_HDRLEN + NLA_ALIGN(len);
+	}
+
+	/*
+	 * send the requests in b at once and hand every reply to fn, until each
+	 * request is answered by a single message, NLMSG_DONE or NLMSG_ERROR.
+	 * a reply too large for the buffer grows it, but is lost with the socket.
+	 */
+	static int
+	genltalk(const uint32_t *b, size_t size,
+	         void (*fn)(const struct nlmsghdr *))
+	{
+		const struct nlmsghdr *req;
+		struct nlmsghdr *nh;
+		struct nlmsgerr *e;
+		struct iovec iov;
+		struct msghdr msg;
+		uint32_t first;
+		size_t pending;
+		ssize_t len;
+		int err;
+		char *tmp;
+
+		if (!wlbuf && !(wlbuf = malloc(wlsize))) {
+			warn("malloc:");
+			return -1;
+		}
+		for (req = (const void *)b, len = size, pending = 0;
+		     NLMSG_OK(req, len); req = NLMSG_NEXT(req, len))
+			pending++;
+		first = wlseq - pending + 1;
+		if (send(wlfd, b, size, 0) < 0) {
+			warn("send 'NETLINK_GENERIC':");
+			return -1;
+		}
+
+		for (err = 0; pending;) {
+			memset(&msg, 0, sizeof(msg));
+			iov.iov_base = wlbuf;
+			iov.iov_len = wlsize;
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			if ((len = recvmsg(wlfd, &msg, 0)) < 0) {
+				if (errno == EINTR)
+					continue;
+				warn("recv 'NETLINK_GENERIC':");
+				return -1;
+			}
+			if (msg.msg_flags & MSG_TRUNC) {
+				if ((tmp = realloc(wlbuf, wlsize * 2))) {
+					wlbuf = tmp;
+					wlsize *= 2;
+				}
+				close(wlfd);
+				wlfd = -1;
+				return -1;
+			}
+			for (nh = (struct nlmsghdr *)wlbuf; NLMSG_OK(nh, len);
+			     nh = NLMSG_NEXT(nh, len)) {
+				/* replies to an earlier, failed round trip */
+				if (nh->nlmsg_seq - first >= wlseq - first + 1)
+					continue;
+				if (nh->nlmsg_type == NLMSG_ERROR) {
+					e = NLMSG_DATA(nh);
+					if (e->error)
+						err = -1;
+				} else if (nh->nlmsg_type != NLMSG_DONE) {
+					fn(nh);
+					if (nh->nlmsg_flags & NLM_F_MULTI)
+						continue;
+				}
+				pending--;
+			}
+		}
+
+		return err;
+	}
+
+	static void
+	fammsg(const struct nlmsghdr *nh)
+	{
+		const struct nlattr *tb[CTRL_ATTR_MAX + 1], *g[CTRL_ATTR_MAX + 1];
+		const struct nlattr *grp;
+		size_t len;
+
+		nlattrs((char *)NLMSG_DATA(nh) + GENL_HDRLEN,
+		        nh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, tb,
+		        CTRL_ATTR_MAX);
+		if (tb[CTRL_ATTR_FAMILY_ID])
+			memcpy(&wlfam, NLA_DATA(tb[CTRL_ATTR_FAMILY_ID]),
+			       sizeof(wlfam));
+		if (!(grp = tb[CTRL_ATTR_MCAST_GROUPS]))
+			return;
+
+		/* the groups are nested once more, by index */
+		for (len = NLA_LEN(grp), grp = NLA_DATA(grp);
+		     len >= NLA_HDRLEN && grp->nla_len >= NLA_HDRLEN &&
+		     grp->nla_len <= len; grp = (const void *)((const char *)grp +
+		     NLA_ALIGN(grp->nla_len))) {
+			nlattrs(NLA_DATA(grp), NLA_LEN(grp), g, CTRL_ATTR_MAX);
+			if (g[CTRL_ATTR_MCAST_GRP_NAME] &&
+			    !strcmp(NLA_DATA(g[CTRL_ATTR_MCAST_GRP_NAME]),
+			            NL80211_MULTICAST_GROUP_MLME))
+				wlmlme = nlu32(g[CTRL_ATTR_MCAST_GRP_ID]);
+			len -= MIN((size_t)NLA_ALIGN(grp->nla_len), len);
+		}
+	}
+
+	/* the socket, and the family and mlme group of nl80211 */
+	static int
+	wlopen(void)
+	{
+		const struct timeval tv = { 1, 0 };
+		struct nlmsghdr *nh;
+		uint32_t b[16];
+		size_t off;
+
+		if (wlfd >= 0)
+			return 0;
+		if ((wlfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+		                   NETLINK_GENERIC)) < 0) {
+			warn("socket 'NETLINK_GENERIC':");
+			return -1;
+		}
+		/* a reply which does not come is given up, as in nlsocket() */
+		if (setsockopt(wlfd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		               sizeof(tv)) < 0) {
+			warn("setsockopt 'SO_RCVTIMEO':");
+			close(wlfd);
+			wlfd = -1;
+			return -1;
+		}
+		if (wlfam)
+			return 0;
+
+		off = 0;
+		nh = genlreq(b, &off, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+		genlattr(nh, &off, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME,
+		         sizeof(NL80211_GENL_NAME));
+		if (genltalk(b, off, fammsg) < 0 || !wlfam) {
+			warn("nl80211 family not found");
+			if (wlfd >= 0)
+				close(wlfd);
+			wlfd = -1;
+			return -1;
+		}
+
+		/* subscribe before the first query to miss nothing */
+		if (wlmlme && (wlmfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+		                              NETLINK_GENERIC)) >= 0 &&
+		    setsockopt(wlmfd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+		               &wlmlme, sizeof(wlmlme)) < 0) {
+			warn("setsockopt 'NETLINK_ADD_MEMBERSHIP':");
+			close(wlmfd);
+			wlmfd = -1;
+		}
+
+		return 0;
+	}
+
+	static struct wlan *
+	findwlan(int index)
+	{
+		size_t i;
+
+		for (i = 0; i < MAXWLAN; i++)
+			if (wlans[i].st.index == index)
+				return &wlans[i];
+
+		return NULL;
+	}
+
+	/* rate of a nested NL80211_RATE_INFO, in 100 kbit/s */
+	static unsigned int
+	bitrate(const struct nlattr *a)
+	{
+		const struct nlattr *ri[NL80211_RATE_INFO_MAX + 1];
+		uint16_t v;
+
+		if (!a)
+			return 0;
+		nlattrs(NLA_DATA(a), NLA_LEN(a), ri, NL80211_RATE_INFO_MAX);
+		if (ri[NL80211_RATE_INFO_BITRATE32])
+			return nlu32(ri[NL80211_RATE_INFO_BITRATE32]);
+		if (!ri[NL80211_RATE_INFO_BITRATE] ||
+		    NLA_LEN(ri[NL80211_RATE_INFO_BITRATE]) < sizeof(v))
+			return 0;
+		memcpy(&v, NLA_DATA(ri[NL80211_RATE_INFO_BITRATE]), sizeof(v));
+
+		return v;
+	}
+
+	static void
+	wlmsg(const struct nlmsghdr *nh)
+	{
+		const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+		const struct nlattr *si[NL80211_STA_INFO_MAX + 1];
+		const struct genlmsghdr *g;
+		const struct nlattr *a;
+		struct wlan *w;
+
+		g = NLMSG_DATA(nh);
+		nlattrs((const char *)g + GENL_HDRLEN,
+		        nh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, tb,
+		        NL80211_ATTR_MAX);
+		if (!(w = findwlan(nlu32(tb[NL80211_ATTR_IFINDEX]))) ||
+		    !w->st.index)
+			return;
+
+		if (g->cmd == NL80211_CMD_NEW_INTERFACE) {
+			if ((a = tb[NL80211_ATTR_SSID])) {
+				memcpy(w->st.ssid, NLA_DATA(a),
+				       MIN(NLA_LEN(a), sizeof(w->st.ssid) - 1));
+				w->st.ssid[MIN(NLA_LEN(a), sizeof(w->st.ssid) - 1)] = '\0';
+			}
+			w->known = 1;
+		} else if (g->cmd == NL80211_CMD_NEW_STATION &&
+		           !w->stations++ && (a = tb[NL80211_ATTR_STA_INFO])) {
+			/* the access point, when managed */
+			nlattrs(NLA_DATA(a), NLA_LEN(a), si, NL80211_STA_INFO_MAX);
+			if ((a = si[NL80211_STA_INFO_SIGNAL_AVG]) ||
+			    (a = si[NL80211_STA_INFO_SIGNAL]))
+				w->st.signal = *(int8_t *)NLA_DATA(a);
+			w->st.txrate = bitrate(si[NL80211_STA_INFO_TX_BITRATE]);
+			w->st.rxrate = bitrate(si[NL80211_STA_INFO_RX_BITRATE]);
+			w->st.expected =
+			    nlu32(si[NL80211_STA_INFO_EXPECTED_THROUGHPUT]);
+		}
+	}
+
+	/* one round trip, with the interface only when its ssid is not known */
+	static int
+	querywlan(struct wlan *w)
+	{
+		struct nlmsghdr *nh;
+		uint32_t b[16], index;
+		size_t off;
+
+		off = 0;
+		index = w->st.index;
+		if (!w->known) {
+			nh = genlreq(b, &off, wlfam, NL80211_CMD_GET_INTERFACE, 0);
+			genlattr(nh, &off, NL80211_ATTR_IFINDEX, &index,
+			         sizeof(index));
+			w->st.ssid[0] = '\0';
+		}
+		nh = genlreq(b, &off, wlfam, NL80211_CMD_GET_STATION, NLM_F_DUMP);
+		genlattr(nh, &off, NL80211_ATTR_IFINDEX, &index, sizeof(index));
+		w->stations = 0;
+		w->st.signal = 0;
+		w->st.txrate = w->st.rxrate = w->st.expected = 0;
+
+		return genltalk(b, off, wlmsg);
+	}
+
+	/* the watch of the mlme group, from the main loop */
+	static int
+	readmlme(int fd, void *unused)
+	{
+		const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+		struct nlmsghdr *nh;
+		struct wlan *w;
+		uint32_t b[1 << 13];
+		ssize_t len;
+		size_t i;
+		int changed;
+
+		pthread_mutex_lock(&wlsrc.lock);
+		for (changed = 0;;) {
+			if ((len = recv(fd, b, sizeof(b), MSG_DONTWAIT |
+			                MSG_TRUNC)) < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != ENOBUFS)
+					break;
+			}
+			/* events were lost or cut off, requery all */
+			if (len < 0 || (size_t)len > sizeof(b)) {
+				for (i = 0; i < MAXWLAN; i++)
+					wlans[i].known = wlans[i].next = 0;
+				changed = 1;
+				continue;
+			}
+			for (nh = (struct nlmsghdr *)b; NLMSG_OK(nh, len);
+			     nh = NLMSG_NEXT(nh, len)) {
+				if (nh->nlmsg_type != wlfam)
+					continue;
+				nlattrs((char *)NLMSG_DATA(nh) + GENL_HDRLEN,
+				        nh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN,
+				        tb, NL80211_ATTR_MAX);
+				if (!(w = findwlan(nlu32(tb[NL80211_ATTR_IFINDEX]))) ||
+				    !w->st.index)
+					continue;
+				w->known = w->next = 0;
+				changed = 1;
+			}
+		}
+		pthread_mutex_unlock(&wlsrc.lock);
+
+		return changed;
+	}
+
+	/* the station is valid until putstations(), which has to follow in any case */
+	const struct station *
+	getstation(const char *name)
+	{
+		struct wlan *w;
+		uintmax_t now;
+		unsigned long t = gettick();
+		size_t i;
+		int signal;
+
+		pthread_mutex_lock(&wlsrc.lock);
+		if (wlopen() < 0)
+			return NULL;
+
+		/* also makes the argument being evaluated depend on it */
+		if (wlmfd >= 0 && watch(wlmfd, readmlme, NULL) == 0)
+			wlwatched = 1;
+
+		for (i = 0, w = NULL; i < MAXWLAN && !w; i++)
+			if (wlans[i].st.index && !strcmp(wlans[i].st.name, name))
+				w = &wlans[i];
+		if (!w) {
+			if (!(w = findwlan(0)))
+				return NULL;
+			memset(w, 0, sizeof(*w));
+			if (!(w->st.index = if_nametoindex(name)))
+				return NULL;
+			esnprintf(w->st.name, sizeof(w->st.name), "%s", name);
+		}
+		now = monotonic();
+		if (w->gen == t || w->next > now)
+			return &w->st;
+
+		w->gen = t;
+		w->known &= wlwatched;
+		signal = w->st.signal;
+		if (querywlan(w) < 0) {
+			/* resolve the name again, it may be a new link */
+			w->st.index = 0;
+			return NULL;
+		}
+		if (wlwatched && w->known && w->st.signal &&
+		    abs(w->st.signal - signal) <= 2)
+			w->backoff = w->backoff ? MIN(w->backoff * 2, MAXBACKOFF) :
+			             MINBACKOFF;
+		else
+			w->backoff = 0;
+		w->next = now + w->backoff;
+
+		return &w->st;
+	}
+
+	void
+	putstations(void)
+	{
+		done(&wlsrc);
+	}
+#endif
+
+/* the list is valid until putifs(), which has to follow in any case */
+struct ifaddrs *
+getifs(void)
+{
+	static struct ifaddrs *ifaddr;
+
+	if (stale(&ifsrc)) {
+		if (ifaddr)
+			freeifaddrs(ifaddr);
+		if ((ifsrc.err = getifaddrs(&ifaddr)) < 0) {
+			warn("getifaddrs:");
+			ifaddr = NULL;
+		}
+	}
+
+	return ifaddr;
+}
+
+void
+putifs(void)
+{
+	done(&ifsrc);
+}
+
+/* the first line of a file, up to size - 1 bytes */
+static int
+readline(const char *path, char *dst, size_t size)
+{
+	char p[PATH_MAX];
+	const char *rp;
+	ssize_t len;
+	char *nl;
+	int fd;
+
+	if (!(rp = rootpath(path, p, sizeof(p)))) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if ((fd = open(rp, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	while ((len = read(fd, dst, size - 1)) < 0 && errno == EINTR)
+		;
+	close(fd);
+	if (len < 0)
+		return -1;
+	dst[len] = '\0';
+	if ((nl = strchr(dst, '\n')))
+		*nl = '\0';
+
+	return 0;
+}
+
+#if defined(__linux__)
+	#include <libgen.h>
+	#include <linux/magic.h>
+	#include <sys/inotify.h>
+	#include <sys/vfs.h>
+
+	/*
+	 * files read again only after inotify tells that they were written or
+	 * replaced. the directory is watched, as a rename over the file would
+	 * end a watch of the file itself. without the main loop the events
+	 * are read on every call. files of /proc, /sys and the like never
+	 * cause events and are read on every call too.
+	 */
+	#define MAXLINES 16
+
+	static struct line {
+		char path[128];
+		const char *base; /* within path */
+		int fd;           /* inotify instance, -1 if none */
+		int watched, stale, err;
+		int pseudo;       /* on a filesystem without events */
+		char line[1024];
+	} lines[MAXLINES];
+
+	static int
+	readnotify(struct line *l)
+	{
+		char b[sizeof(struct inotify_event) + NAME_MAX + 1]
+			__attribute__((aligned(__alignof__(struct inotify_event))));
+		const struct inotify_event *e;
+		ssize_t len;
+		char *p;
+		int changed, gone;
+
+		for (changed = gone = 0;;) {
+			if ((len = read(l->fd, b, sizeof(b))) < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (p = b; p < b + len; p += sizeof(*e) + e->len) {
+				e = (const struct inotify_event *)p;
+				gone |= e->mask & IN_IGNORED;
+				if ((e->mask & (IN_Q_OVERFLOW | IN_IGNORED)) ||
+				    (e->len && !strcmp(e->name, l->base)))
+					changed = l->stale = 1;
+			}
+		}
+
+		/* the directory is gone, watch it again on the next call */
+		if (gone) {
+			unwatch(l->fd);
+			close(l->fd);
+			l->fd = -1;
+			l->watched = 0;
+		}
+
+		return changed;
+	}
+
+	/* the watch of the directory, from the main loop */
+	static int
+	readlines(int fd, void *data)
+	{
+		int changed;
+
+		pthread_mutex_lock(&linesrc.lock);
+		changed = readnotify(data);
+		pthread_mutex_unlock(&linesrc.lock);
+
+		return changed;
+	}
+
+	static void
+	notify(struct line *l)
+	{
+		char p[PATH_MAX], d[PATH_MAX], *dir;
+		const char *rp;
+		struct statfs sf;
+
+		l->fd = -1;
+		if (!(rp = rootpath(l->path, p, sizeof(p))) ||
+		    esnprintf(d, sizeof(d), "%s", rp) < 0 ||
+		    statfs((dir = dirname(d)), &sf) < 0)
+			return;
+
+		/* attributes of /proc and /sys change without any event */
+		switch (sf.f_type) {
+		case PROC_SUPER_MAGIC:
+		case SYSFS_MAGIC:
+		case DEBUGFS_MAGIC:
+		case CGROUP_SUPER_MAGIC:
+		case CGROUP2_SUPER_MAGIC:
+			l->pseudo = 1;
+			return;
+		}
+
+		/* a writer keeping the file open only causes IN_MODIFY */
+		if ((l->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+			warn("inotify_init1:");
+			return;
+		}
+		if (inotify_add_watch(l->fd, dir, IN_MODIFY | IN_CLOSE_WRITE |
+		                      IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+		                      IN_ONLYDIR) < 0) {
+			close(l->fd);
+			l->fd = -1;
+		}
+	}
+
+	/*
+	 * the first line of path, up to size - 1 bytes, read again only when
+	 * it changed
+	 */
+	int
+	watchline(const char *path, char *dst, size_t size)
+	{
+		struct line *l;
+		const char *base;
+		size_t i, len;
+		int err;
+
+		pthread_mutex_lock(&linesrc.lock);
+		for (i = 0, l = NULL; i < MAXLINES && !l; i++)
+			if (!lines[i].path[0] || !strcmp(lines[i].path, path))
+				l = &lines[i];
+		if (!l || (!l->path[0] &&
+		    esnprintf(l->path, sizeof(l->path), "%s", path) < 0)) {
+			if (l)
+				l->path[0] = '\0';
+			pthread_mutex_unlock(&linesrc.lock);
+			return readline(path, dst, size);
+		}
+
+		/* subscribe before the read to miss nothing */
+		if (!l->base) {
+			l->base = (base = strrchr(l->path, '/')) ? base + 1 :
+			          l->path;
+			l->fd = -1;
+		}
+		if (l->fd < 0 && !l->pseudo) {
+			notify(l);
+			l->stale = 1;
+		}
+
+		/* also makes the argument being evaluated depend on it */
+		if (l->fd >= 0 && watch(l->fd, readlines, l) == 0)
+			l->watched = 1;
+		if (l->fd >= 0 && !l->watched)
+			readnotify(l);
+
+		if (l->stale || l->fd < 0) {
+			l->stale = 0;
+			l->err = readline(path, l->line, sizeof(l->line)) < 0 ?
+			         errno : 0;
+		}
+		len = l->err ? 0 : MIN(strlen(l->line), size - 1);
+		memcpy(dst, l->line, len);
+		dst[len] = '\0';
+		err = l->err;
+		pthread_mutex_unlock(&linesrc.lock);
+
+		if (err) {
+			errno = err;
+			return -1;
+		}
+
+		return 0;
+	}
+#else
+	int
+	watchline(const char *path, char *dst, size_t size)
+	{
+		return readline(path, dst, size);
+	}
+#endif
+
+/*
+ * the keyboard state, from a connection to the X server of its own, kept
+ * open. XKB events tell about a new group, symbols or indicators, from the
+ * main loop when it watches the connection, else on every call.
+ */
+static Display *xkbdpy;
+static int xkbevent, xkbwatched;
+static struct xkbstate xkb;
+
+static int
+xkbnames(void)
+{
+	XkbDescRec *desc;
+	char *symbols;
+	int ret;
+
+	if (!(desc = XkbAllocKeyboard())) {
+		warn("XkbAllocKeyboard: Failed to allocate keyboard");
+		return -1;
+	}
+	ret = -1;
+	if (XkbGetNames(xkbdpy, XkbSymbolsNameMask, desc)) {
+		warn("XkbGetNames: Failed to retrieve key symbols");
+	} else if (!(symbols = XGetAtomName(xkbdpy, desc->names->symbols))) {
+		warn("XGetAtomName: Failed to get atom name");
+	} else {
+		esnprintf(xkb.symbols, sizeof(xkb.symbols), "%s", symbols);
+		XFree(symbols);
+		ret = 0;
+	}
+	XkbFreeKeyboard(desc, XkbSymbolsNameMask, 1);
+
+	return ret;
+}
+
+static int
+xkbread(void)
+{
+	XkbStateRec state;
+
+	if (XkbGetState(xkbdpy, XkbUseCoreKbd, &state)) {
+		warn("XkbGetState: Failed to retrieve keyboard state");
+		return -1;
+	}
+	xkb.group = state.group;
+	if (XkbGetIndicatorState(xkbdpy, XkbUseCoreKbd, &xkb.leds)) {
+		warn("XkbGetIndicatorState: Failed to retrieve indicators");
+		return -1;
+	}
+
+	return xkbnames();
+}
+
+static int
+xkbevents(void)
+{
+	XkbEvent ev;
+	int changed;
+
+	for (changed = 0; XPending(xkbdpy); ) {
+		XNextEvent(xkbdpy, &ev.core);
+		if (ev.type != xkbevent)
+			continue;
+
+		switch (ev.any.xkb_type) {
+		case XkbStateNotify:
+			changed |= xkb.group != ev.state.group;
+			xkb.group = ev.state.group;
+			break;
+		case XkbIndicatorStateNotify:
+			changed |= xkb.leds != ev.indicators.state;
+			xkb.leds = ev.indicators.state;
+			break;
+		case XkbNamesNotify:
+		case XkbNewKeyboardNotify:
+			xkbsrc.err = xkbread();
+			changed = 1;
+			break;
+		}
+	}
+
+	return changed;
+}
+
+/* the watch of the connection, from the main loop */
+static int
+readxkb(int fd, void *unused)
+{
+	int changed;
+
+	pthread_mutex_lock(&xkbsrc.lock);
+	changed = xkbevents();
+	pthread_mutex_unlock(&xkbsrc.lock);
+
+	return changed;
+}
+
+/* the state is valid until putxkb(), which has to follow in any case */
+const struct xkbstate *
+getxkb(void)
+{
+	int major = XkbMajorVersion, minor = XkbMinorVersion;
+	unsigned long t = gettick();
+
+	pthread_mutex_lock(&xkbsrc.lock);
+	if (!xkbdpy) {
+		if (xkbsrc.gen == t)
+			return NULL;
+		/* retried once a tick */
+		xkbsrc.gen = t;
+		if (!(xkbdpy = XkbOpenDisplay(NULL, &xkbevent, NULL, &major,
+		                              &minor, NULL))) {
+			warn("XkbOpenDisplay: Failed to open display");
+			return NULL;
+		}
+
+		/* subscribe before the read to miss nothing */
+		XkbSelectEvents(xkbdpy, XkbUseCoreKbd, XkbNewKeyboardNotifyMask |
+		                XkbNamesNotifyMask | XkbIndicatorStateNotifyMask,
+		                XkbNewKeyboardNotifyMask | XkbNamesNotifyMask |
+		                XkbIndicatorStateNotifyMask);
+		XkbSelectEventDetails(xkbdpy, XkbUseCoreKbd, XkbNamesNotify,
+		                      XkbAllNamesMask, XkbSymbolsNameMask);
+		/* not every modifier press, only the group */
+		XkbSelectEventDetails(xkbdpy, XkbUseCoreKbd, XkbStateNotify,
+		                      XkbAllStateComponentsMask, XkbGroupStateMask);
+		xkbsrc.err = xkbread();
+		xkbevents();
+	} else if (xkbsrc.err) {
+		xkbsrc.err = xkbread();
+	}
+
+	/* also makes the argument being evaluated depend on it */
+	if (watch(ConnectionNumber(xkbdpy), readxkb, NULL) == 0)
+		xkbwatched = 1;
+	if (!xkbwatched)
+		xkbevents();
+	if (xkbsrc.err)
+		return NULL;
+
+	return &xkb;
+}
+
+void
+putxkb(void)
+{
+	done(&xkbsrc);
+}
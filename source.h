@@ -0,0 +1,87 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+
+/*
+ * data shared by several components. each source is read at most once per
+ * tick of the main loop, whichever component asks first, and all of them
+ * get the same snapshot.
+ */
+unsigned long gettick(void);
+void nexttick(void);
+
+struct meminfo {
+	uintmax_t total, free, buffers, cached, shmem, sreclaimable; /* kB */
+	uintmax_t swaptotal, swapfree, swapcached;                   /* kB */
+	int ram, swap; /* the fields of either were all found */
+};
+
+struct cpustat {
+	/* aggregate jiffies of all cpus */
+	uintmax_t user, nice, system, idle, iowait, irq, softirq, steal;
+};
+
+/* busy share of every cpu since the previous read, in /proc/stat order */
+#define MAXCPU 1024
+
+struct cpucores {
+	size_t n;
+	unsigned int id[MAXCPU];
+	unsigned char perc[MAXCPU]; /* 0 to 100 */
+};
+
+/* current frequency (in kHz, 0 if unknown) and cluster of every cpu */
+struct cpufreqs {
+	size_t n;
+	uintmax_t khz[MAXCPU];
+	int cluster[MAXCPU];
+};
+
+#if defined(__linux__)
+#include <net/if.h>
+#include <linux/if_link.h>
+
+/* counters of a network interface at the last two reads (in ms) */
+struct link {
+	int index;
+	char name[IF_NAMESIZE];
+	struct rtnl_link_stats64 cur, prev;
+	uintmax_t tcur, tprev;
+	unsigned long gen;
+};
+
+/* association of a wireless interface at the last query */
+struct station {
+	int index;
+	char name[IF_NAMESIZE];
+	char ssid[33];               /* empty unless associated */
+	int signal;                  /* average, in dBm, 0 if unknown */
+	unsigned int txrate, rxrate; /* in 100 kbit/s, 0 if unknown */
+	unsigned int expected;       /* throughput, in kbit/s, 0 if unknown */
+};
+
+const struct link *getlink(const char *name);
+void putlinks(void);
+const struct station *getstation(const char *name);
+void putstations(void);
+int linkstate(const char *name, unsigned int *flags, unsigned char *oper);
+int linkaddr(const char *name, int family, char *dst, size_t size);
+#endif
+
+/* layout group and indicators of the core keyboard */
+struct xkbstate {
+	char symbols[256]; /* name of the symbols, like pc+us+de:2+inet(evdev) */
+	int group;
+	unsigned int leds; /* bit i set if indicator i is on */
+};
+
+int meminfo(struct meminfo *mi);
+int cpustat(struct cpustat *cs);
+const struct cpucores *getcores(void);
+void putcores(void);
+const struct cpufreqs *getfreqs(void);
+void putfreqs(void);
+struct ifaddrs *getifs(void);
+void putifs(void);
+int watchline(const char *path, char *dst, size_t size);
+const struct xkbstate *getxkb(void);
+void putxkb(void);
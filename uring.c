@@ -0,0 +1,147 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "util.h"
+
+/* the ring is set up without liburing, by the raw syscalls */
+static struct {
+	int fd;
+	unsigned int entries;
+	unsigned int *sqtail, *sqmask, *sqarray;
+	unsigned int *cqhead, *cqtail, *cqmask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} ring = { -1 };
+static pthread_mutex_t ringlock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long uringenters;
+
+int
+uringinit(unsigned int entries)
+{
+	struct io_uring_params p;
+	size_t sqlen, cqlen;
+	int fd;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	if ((fd = syscall(SYS_io_uring_setup, entries, &p)) < 0)
+		return -1;
+
+	/* older kernels map the completion queue separately */
+	sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sqlen = cqlen = (sqlen > cqlen) ? sqlen : cqlen;
+
+	if ((sq = mmap(NULL, sqlen, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, fd,
+	               IORING_OFF_SQ_RING)) == MAP_FAILED)
+		goto err;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else if ((cq = mmap(NULL, cqlen, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED | MAP_POPULATE, fd,
+	                    IORING_OFF_CQ_RING)) == MAP_FAILED)
+		goto err;
+	if ((ring.sqes = mmap(NULL, p.sq_entries * sizeof(*ring.sqes),
+	                      PROT_READ | PROT_WRITE,
+	                      MAP_SHARED | MAP_POPULATE, fd,
+	                      IORING_OFF_SQES)) == MAP_FAILED)
+		goto err;
+
+	pthread_mutex_lock(&ringlock);
+	ring.fd = fd;
+	ring.entries = p.sq_entries;
+	ring.sqtail = (unsigned int *)(sq + p.sq_off.tail);
+	ring.sqmask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ring.sqarray = (unsigned int *)(sq + p.sq_off.array);
+	ring.cqhead = (unsigned int *)(cq + p.cq_off.head);
+	ring.cqtail = (unsigned int *)(cq + p.cq_off.tail);
+	ring.cqmask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	pthread_mutex_unlock(&ringlock);
+
+	return 0;
+err:
+	/* the mappings go away with the process, they are not retried */
+	close(fd);
+
+	return -1;
+}
+
+/*
+ * read the start of n files in a single io_uring_enter(2). res[i] is the
+ * length read or -errno like for pread(2). batches of several threads are
+ * submitted one after the other. after the ring failed it is given up, as
+ * its queued reads would later write into buffers gone by then.
+ */
+int
+uringread(size_t n, const int *fd, char *const *b, const size_t *size,
+          ssize_t *res)
+{
+	static uint32_t seq;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned int tail, head, i;
+	uint64_t batch;
+
+	pthread_mutex_lock(&ringlock);
+	if (ring.fd < 0 || n > ring.entries) {
+		pthread_mutex_unlock(&ringlock);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the batch is in the upper half of user_data, the read below */
+	batch = (uint64_t)++seq << 32;
+	tail = *ring.sqtail;
+	for (i = 0; i < n; i++, tail++) {
+		sqe = &ring.sqes[tail & *ring.sqmask];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd[i];
+		sqe->addr = (uintptr_t)b[i];
+		sqe->len = size[i];
+		sqe->off = 0;
+		sqe->user_data = batch | i;
+		ring.sqarray[tail & *ring.sqmask] = tail & *ring.sqmask;
+		res[i] = -ECANCELED;
+	}
+	__atomic_store_n(ring.sqtail, tail, __ATOMIC_RELEASE);
+
+	for (;;) {
+		uringenters++;
+		if (syscall(SYS_io_uring_enter, ring.fd, n, n,
+		            IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+			break;
+		if (errno != EINTR) {
+			warn("io_uring_enter:");
+			close(ring.fd);
+			ring.fd = -1;
+			pthread_mutex_unlock(&ringlock);
+			return -1;
+		}
+	}
+
+	/* completions of an earlier batch are dropped */
+	head = *ring.cqhead;
+	while (head != __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE)) {
+		cqe = &ring.cqes[head++ & *ring.cqmask];
+		if ((cqe->user_data & ~(uint64_t)UINT32_MAX) == batch &&
+		    (cqe->user_data & UINT32_MAX) < n)
+			res[cqe->user_data & UINT32_MAX] = cqe->res;
+	}
+	__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&ringlock);
+
+	return 0;
+}
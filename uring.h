@@ -0,0 +1,10 @@
+/* See LICENSE file for copyright and license details. */
+#include <stddef.h>
+#include <sys/types.h>
+
+/* a minimal io_uring for batches of reads */
+extern unsigned long uringenters; /* io_uring_enter(2) calls made */
+
+int uringinit(unsigned int entries);
+int uringread(size_t n, const int *fd, char *const *b, const size_t *size,
+              ssize_t *res);
@@ -1,11 +1,19 @@
 /* See LICENSE file for copyright and license details. */
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "uring.h"
 #include "util.h"
 
 char *argv0;
@@ -121,38 +129,575 @@ fmt_human(uintmax_t num, int base)
 	return bprintf("%.1f %s", scaled, prefix[i]);
 }
 
+/* monotonic time in ms */
+uintmax_t
+monotonic(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		die("clock_gettime:");
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * absolute paths are resolved below $SLSTATUS_SYSROOT if it is set, to read
+ * a captured /proc and /sys instead of the live ones. dst holds the result,
+ * path itself is returned when there is no root.
+ */
+const char *
+rootpath(const char *path, char *dst, size_t size)
+{
+	static const char *root;
+	static int init;
+
+	if (!init) {
+		if ((root = getenv("SLSTATUS_SYSROOT")) && !root[0])
+			root = NULL;
+		init = 1;
+	}
+	if (!root || path[0] != '/')
+		return path;
+
+	return (esnprintf(dst, size, "%s%s", root, path) < 0) ? NULL : dst;
+}
+
+FILE *
+rfopen(const char *path, const char *mode)
+{
+	char p[PATH_MAX];
+	const char *rp;
+
+	if (!(rp = rootpath(path, p, sizeof(p)))) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	return fopen(rp, mode);
+}
+
+/*
+ * attribute files of /proc and /sys are kept open and reread from the start
+ * with pread(2), one syscall per value instead of open, read and close.
+ * entries in use by another thread are not evicted, a file whose device is
+ * gone (ENODEV, ESTALE) is closed and opened again on the next read.
+ */
+#define NFDS 32
+#define PRESIZE 8192
+
+static struct fdent {
+	char path[128];
+	int fd;
+	unsigned int refs;
+	int dead;
+	uint64_t readers; /* arguments which read the file */
+	ssize_t prelen;   /* length read ahead, -1 if none */
+} fds[NFDS];
+static size_t fdnext;
+static pthread_mutex_t fdlock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * with io_uring, the files of the due arguments are read ahead in one
+ * batch at the start of every update, and the reads of the components are
+ * served from the copies.
+ */
+static char prebuf[NFDS][PRESIZE];
+static int batch;
+__thread unsigned int reader;
+
+static int
+ropen(const char *path)
+{
+	char p[PATH_MAX];
+	const char *rp;
+
+	if (!(rp = rootpath(path, p, sizeof(p)))) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	return open(rp, O_RDONLY | O_CLOEXEC);
+}
+
+/*
+ * returns the entry of path with a reference held. errno is EBUSY if path
+ * is too long or all entries are busy, the caller reads it uncached then.
+ */
+static struct fdent *
+getfd(const char *path)
+{
+	struct fdent *e;
+	size_t i, len;
+	int fd;
+
+	if ((len = strlen(path)) >= sizeof(fds[0].path)) {
+		errno = EBUSY;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&fdlock);
+	for (i = 0; i < NFDS; i++) {
+		e = &fds[i];
+		if (e->path[0] && !e->dead && !strcmp(e->path, path))
+			goto found;
+	}
+
+	/* evict the next unused entry round-robin */
+	for (i = 0; i < NFDS; i++) {
+		e = &fds[(fdnext + i) % NFDS];
+		if (!e->refs)
+			break;
+	}
+	if (i == NFDS) {
+		pthread_mutex_unlock(&fdlock);
+		errno = EBUSY;
+		return NULL;
+	}
+	fdnext = (fdnext + i + 1) % NFDS;
+
+	if ((fd = ropen(path)) < 0) {
+		pthread_mutex_unlock(&fdlock);
+		return NULL;
+	}
+	if (e->path[0])
+		close(e->fd);
+	memcpy(e->path, path, len + 1);
+	e->fd = fd;
+	e->dead = 0;
+	e->readers = 0;
+	e->prelen = -1;
+found:
+	if (reader && reader <= 64)
+		e->readers |= UINT64_C(1) << (reader - 1);
+	e->refs++;
+	pthread_mutex_unlock(&fdlock);
+
+	return e;
+}
+
+static void
+putfd(struct fdent *e, int dead)
+{
+	pthread_mutex_lock(&fdlock);
+	e->dead |= dead;
+	if (!--e->refs && e->dead) {
+		close(e->fd);
+		e->path[0] = '\0';
+	}
+	pthread_mutex_unlock(&fdlock);
+}
+
+/* take the read-ahead copy of e, if there is one which is large enough */
+static ssize_t
+takepre(struct fdent *e, char *b, size_t size)
+{
+	ssize_t n;
+
+	pthread_mutex_lock(&fdlock);
+	if ((n = e->prelen) >= 0 && (n < PRESIZE || size <= (size_t)n)) {
+		n = MIN((size_t)n, size);
+		memcpy(b, prebuf[e - fds], n);
+		e->prelen = -1;
+	} else {
+		n = -1;
+	}
+	pthread_mutex_unlock(&fdlock);
+
+	return n;
+}
+
+/* read up to size bytes from the start of path */
+ssize_t
+pslurp(const char *path, char *b, size_t size)
+{
+	struct fdent *e;
+	ssize_t n;
+	int fd, try;
+
+	for (try = 0; try < 2; try++) {
+		if (!(e = getfd(path))) {
+			if (errno != EBUSY || (fd = ropen(path)) < 0)
+				return -1;
+			n = read(fd, b, size);
+			close(fd);
+			return n;
+		}
+		if (!batch || (n = takepre(e, b, size)) < 0)
+			n = pread(e->fd, b, size, 0);
+		putfd(e, n < 0 && (errno == ENODEV || errno == ESTALE));
+		/* the device is gone, try to open it again once */
+		if (n >= 0 || (errno != ENODEV && errno != ESTALE))
+			break;
+	}
+
+	return n;
+}
+
+int
+prefetchinit(void)
+{
+	if (uringinit(NFDS) < 0)
+		return -1;
+	batch = 1;
+
+	return 0;
+}
+
+/*
+ * read ahead the files of the readers in the due mask, bit i being reader
+ * i + 1, with a single syscall. copies which were not taken are dropped.
+ */
+void
+prefetch(uint64_t due)
+{
+	struct fdent *e[NFDS];
+	ssize_t res[NFDS];
+	size_t size[NFDS], i, n;
+	int fd[NFDS];
+	char *b[NFDS];
+
+	if (!batch)
+		return;
+
+	pthread_mutex_lock(&fdlock);
+	for (i = n = 0; i < NFDS; i++) {
+		fds[i].prelen = -1;
+		if (!fds[i].path[0] || fds[i].dead || !(fds[i].readers & due))
+			continue;
+		fds[i].refs++;
+		e[n] = &fds[i];
+		fd[n] = fds[i].fd;
+		b[n] = prebuf[i];
+		size[n++] = PRESIZE;
+	}
+	pthread_mutex_unlock(&fdlock);
+
+	if (!n)
+		return;
+	if (uringread(n, fd, b, size, res) < 0)
+		for (i = 0; i < n; i++)
+			res[i] = -1;
+
+	for (i = 0; i < n; i++) {
+		pthread_mutex_lock(&fdlock);
+		e[i]->prelen = (res[i] >= 0) ? res[i] : -1;
+		pthread_mutex_unlock(&fdlock);
+		putfd(e[i], res[i] == -ENODEV || res[i] == -ESTALE);
+	}
+}
+
 int
 pscanf(const char *path, const char *fmt, ...)
 {
-	FILE *fp;
 	va_list ap;
+	ssize_t len;
 	int n;
+	char b[4096];
 
-	if (!(fp = fopen(path, "r"))) {
-		warn("fopen '%s':", path);
+	if ((len = pslurp(path, b, sizeof(b) - 1)) < 0) {
+		warn("read '%s':", path);
 		return -1;
 	}
+	b[len] = '\0';
+
 	va_start(ap, fmt);
-	n = vfscanf(fp, fmt, ap);
+	n = vsscanf(b, fmt, ap);
 	va_end(ap);
-	fclose(fp);
 
 	return (n == EOF) ? -1 : n;
 }
 
-int
-lscanf(FILE *fp, const char *key, const char *fmt, void *res)
+/*
+ * scanners for the lines, blanks and numbers of procfs files, which get
+ * wide on hosts with many cpus or devices. on x86-64 they look at 16 or 32
+ * bytes at a time, picked at runtime. buffers have to be NUL-terminated
+ * and readable for SCANPAD bytes past the NUL.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+
+	#define AVX2 __attribute__((target("avx2")))
+
+	static AVX2 const char *
+	avx2line(const char *s, const char *end)
+	{
+		const __m256i nl = _mm256_set1_epi8('\n');
+		unsigned int m;
+
+		for (; s < end; s += 32)
+			if ((m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			     _mm256_loadu_si256((const __m256i *)s), nl))))
+				return MIN(s + __builtin_ctz(m), end);
+
+		return end;
+	}
+
+	static const char *
+	sse2line(const char *s, const char *end)
+	{
+		const __m128i nl = _mm_set1_epi8('\n');
+		unsigned int m;
+
+		for (; s < end; s += 16)
+			if ((m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			     _mm_loadu_si128((const __m128i *)s), nl))))
+				return MIN(s + __builtin_ctz(m), end);
+
+		return end;
+	}
+
+	static AVX2 const char *
+	avx2blank(const char *s)
+	{
+		const __m256i sp = _mm256_set1_epi8(' ');
+		const __m256i tab = _mm256_set1_epi8('\t');
+		__m256i x;
+		unsigned int m;
+
+		for (;; s += 32) {
+			x = _mm256_loadu_si256((const __m256i *)s);
+			m = _mm256_movemask_epi8(_mm256_or_si256(
+			    _mm256_cmpeq_epi8(x, sp), _mm256_cmpeq_epi8(x, tab)));
+			if (~m)
+				return s + __builtin_ctz(~m);
+		}
+	}
+
+	static const char *
+	sse2blank(const char *s)
+	{
+		const __m128i sp = _mm_set1_epi8(' ');
+		const __m128i tab = _mm_set1_epi8('\t');
+		__m128i x;
+		unsigned int m;
+
+		for (;; s += 16) {
+			x = _mm_loadu_si128((const __m128i *)s);
+			m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, sp),
+			                                   _mm_cmpeq_epi8(x, tab)));
+			if (m != 0xffff)
+				return s + __builtin_ctz(~m);
+		}
+	}
+
+	/*
+	 * up to 15 digits at once: right-align them, then combine pairs,
+	 * groups of four and of eight with multiply-adds
+	 */
+	static AVX2 const char *
+	avx2num(const char *s, uintmax_t *v)
+	{
+		static const signed char align[32] = {
+			-128, -128, -128, -128, -128, -128, -128, -128,
+			-128, -128, -128, -128, -128, -128, -128, -128,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		};
+		__m128i x;
+		unsigned int m, n;
+
+		x = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)s),
+		                 _mm_set1_epi8('0'));
+		/* the bytes which are not digits, 0 to 9 unsigned */
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+		    _mm_max_epu8(x, _mm_set1_epi8(10)), x));
+		if (!m)
+			return NULL;
+		if (!(n = __builtin_ctz(m)))
+			return NULL;
+
+		x = _mm_shuffle_epi8(x, _mm_loadu_si128(
+		    (const __m128i *)(align + n)));
+		x = _mm_maddubs_epi16(x, _mm_set1_epi16(0x010a));
+		x = _mm_madd_epi16(x, _mm_set1_epi32(0x00010064));
+		x = _mm_packus_epi32(x, x);
+		x = _mm_madd_epi16(x, _mm_set1_epi32(0x00012710));
+		*v = (uintmax_t)(uint32_t)_mm_cvtsi128_si32(x) * 100000000 +
+		     (uint32_t)_mm_extract_epi32(x, 1);
+
+		return s + n;
+	}
+#endif
+
+static const char *
+scalarnum(const char *s, uintmax_t *v)
 {
-		int n;
-		char line[256];
+	const char *start;
+	unsigned int d;
 
-		n = -1;
-		while (fgets(line, sizeof(line), fp))
-			if (strncmp(line, key, strlen(key)) == 0) {
-				n = sscanf(line + strlen(key), fmt, res);
-				break;
+	for (start = s, *v = 0; (d = (unsigned char)*s - '0') < 10; s++)
+		*v = *v * 10 + d;
+
+	return (s == start) ? NULL : s;
+}
+
+/* the newline ending the line at s, or end */
+const char *
+scanline(const char *s, const char *end)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+		return avx2line(s, end);
+	return sse2line(s, end);
+#else
+	const char *p;
+
+	return (p = memchr(s, '\n', end - s)) ? p : end;
+#endif
+}
+
+/* the first character at s which is not a blank */
+const char *
+skipblank(const char *s)
+{
+	/* mostly there is a single one */
+	if (*s != ' ' && *s != '\t')
+		return s;
+	if (*++s != ' ' && *s != '\t')
+		return s;
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (__builtin_cpu_supports("avx2"))
+		return avx2blank(s);
+	return sse2blank(s);
+#else
+	while (*s == ' ' || *s == '\t')
+		s++;
+
+	return s;
+#endif
+}
+
+/* parse the decimal number at s, returns its end or NULL if there is none */
+const char *
+scannum(const char *s, uintmax_t *v)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	const char *end;
+
+	/* longer numbers than the vector holds are done one by one */
+	if (__builtin_cpu_supports("avx2") && (end = avx2num(s, v)))
+		return end;
+#endif
+	return scalarnum(s, v);
+}
+
+/*
+ * read path in one go and fill in the numbers of every field whose key
+ * starts a line, in a single pass over the lines. returns the mask of the
+ * fields found, the first in the lowest bit, or 0.
+ */
+uint64_t
+pfields(const char *path, const struct field *f, size_t n)
+{
+	uint64_t found;
+	ssize_t len;
+	size_t i, j, left;
+	const char *p, *q, *end;
+	char b[8192 + SCANPAD];
+
+	if (n > 64)
+		n = 64;
+	if ((len = pslurp(path, b, sizeof(b) - SCANPAD - 1)) < 0) {
+		warn("read '%s':", path);
+		return 0;
+	}
+	b[len] = '\0';
+
+	found = 0;
+	left = n;
+	for (p = b; left && p < b + len; p = end + 1) {
+		end = scanline(p, b + len);
+		for (i = 0; i < n; i++) {
+			if ((found >> i & 1) || strncmp(p, f[i].key, f[i].len))
+				continue;
+			for (j = 0, q = p + f[i].len; j < f[i].n; j++)
+				if (!(q = scannum(skipblank(q), &f[i].val[j])))
+					break;
+			if (j == f[i].n) {
+				found |= (uint64_t)1 << i;
+				left--;
 			}
+			break;
+		}
+	}
+
+	return found;
+}
+
+int
+pnum(const char *path, uintmax_t *v)
+{
+	const struct field f[] = { FIELD("", v, 1) };
+
+	return (pfields(path, f, 1) == 1) ? 1 : -1;
+}
+
+/*
+ * run cmd with its stdout on a pipe, *fd is the read end. commands without
+ * shell syntax are executed directly, others through the shell. unlike
+ * popen(3) the child does not inherit our blocked signal mask. it leads a
+ * process group of its own, so that it can be killed with its children.
+ */
+pid_t
+spawn(const char *cmd, int *fd)
+{
+	extern char **environ;
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	pid_t pid;
+	size_t n;
+	int p[2], err;
+	const char *path;
+	char words[1024], *argv[32], *w, *save;
+
+	/* split plain commands into words, leave the rest to sh -c */
+	n = 0;
+	if (!strpbrk(cmd, "|&;<>()$`\\\"'*?[]#~=%!{}\n") &&
+	    esnprintf(words, sizeof(words), "%s", cmd) >= 0)
+		for (w = strtok_r(words, " \t", &save); w && n < LEN(argv) - 1;
+		     w = strtok_r(NULL, " \t", &save))
+			argv[n++] = w;
+	if (!n || n == LEN(argv) - 1) {
+		path = "/bin/sh";
+		argv[0] = "sh";
+		argv[1] = "-c";
+		argv[2] = (char *)cmd;
+		n = 3;
+	} else {
+		path = argv[0];
+	}
+	argv[n] = NULL;
+
+	if (pipe(p) < 0) {
+		warn("pipe:");
+		return -1;
+	}
+	fcntl(p[0], F_SETFD, FD_CLOEXEC);
+	fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
+	sigemptyset(&mask);
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+	                         POSIX_SPAWN_SETPGROUP);
+
+	err = posix_spawnp(&pid, path, &fa, &attr, argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fa);
+	close(p[1]);
+
+	if (err) {
+		errno = err;
+		warn("posix_spawn '%s':", cmd);
+		close(p[0]);
+		return -1;
+	}
 
-		rewind(fp);
-		return (n == 1) ? 1 : -1;
+	*fd = p[0];
+	return pid;
 }
@@ -1,10 +1,12 @@
 /* See LICENSE file for copyright and license details. */
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
-extern char buf[1024];
+extern __thread char buf[1024];
 
 #define LEN(x) (sizeof(x) / sizeof((x)[0]))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 extern char *argv0;
 
@@ -14,5 +16,31 @@ void die(const char *, ...);
 int esnprintf(char *str, size_t size, const char *fmt, ...);
 const char *bprintf(const char *fmt, ...);
 const char *fmt_human(uintmax_t num, int base);
+uintmax_t monotonic(void);
+const char *rootpath(const char *path, char *dst, size_t size);
+FILE *rfopen(const char *path, const char *mode);
+/* the argument being evaluated, from 1, whose reads prefetch() repeats */
+extern __thread unsigned int reader;
+int prefetchinit(void);
+void prefetch(uint64_t due);
+ssize_t pslurp(const char *path, char *b, size_t size);
 int pscanf(const char *path, const char *fmt, ...);
-int lscanf(FILE *fp, const char *key, const char *fmt, void *res);
+
+/* a line starting with key, followed by n numbers stored to val */
+struct field {
+	const char *key;
+	size_t len;
+	uintmax_t *val;
+	size_t n;
+};
+#define FIELD(k, v, n) { (k), sizeof(k) - 1, (v), (n) }
+
+/* readable bytes needed past the NUL of buffers given to the scanners */
+#define SCANPAD 32
+
+const char *scanline(const char *s, const char *end);
+const char *skipblank(const char *s);
+const char *scannum(const char *s, uintmax_t *v);
+uint64_t pfields(const char *path, const struct field *f, size_t n);
+int pnum(const char *path, uintmax_t *v);
+pid_t spawn(const char *cmd, int *fd);